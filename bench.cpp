@@ -0,0 +1,181 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "gl.hpp"
+
+// Rasterizer throughput for small triangles: shades the vertices once, then times
+// gl::triangles alone over randomly placed right triangles of each area.
+
+namespace {
+
+template<typename T>
+struct Vertex {
+  VERTEX_SHADER(Vertex, T);
+
+  ATTRIBUTE(position, vec2);
+  ATTRIBUTE(aColor, vec3);
+  VARYING(vColor, vec3);
+
+  void
+  main() {
+    gl_Position = vec4(position, 0.0, 1.0);
+    vColor = aColor;
+  }
+};
+
+template<typename T>
+struct Transform {
+  VERTEX_SHADER(Transform, T);
+
+  UNIFORM(matrix, mat4);
+  ATTRIBUTE(position, vec3);
+  ATTRIBUTE(normal, vec3);
+  VARYING(vColor, vec3);
+
+  void
+  main() {
+    gl_Position = matrix * vec4(position, 1.0);
+    vColor = normalize(vec3(matrix * vec4(normal, 0.0))) * Float(0.5) + Float(0.5);
+  }
+};
+
+template<typename T>
+struct Fragment {
+  FRAGMENT_SHADER(Fragment, T);
+
+  VARYING(vColor, vec3);
+
+  void
+  main() {
+    gl_FragColor = vec4(vColor, 1.0);
+  }
+};
+
+}
+
+// the SIMD matrix product on operands 16 but not 32 byte aligned, against the
+// definition
+static bool
+check_product() {
+  using mat4 = ::gl::sl::mat<4,float>;
+
+  alignas(32) char storage[3*sizeof(mat4) + 16];
+  auto m = (mat4 *)(storage + 16);
+
+  for(size_t i=0; i<4; i++)
+    for(size_t j=0; j<4; j++) {
+      m[0][i][j] = float(i*4 + j) - 7.5f;
+      m[1][i][j] = float((i + 2*j) % 5) * 0.25f;
+    }
+
+  m[2] = m[0] * m[1];
+
+  for(size_t i=0; i<4; i++)
+    for(size_t k=0; k<4; k++) {
+      float r = 0.0f;
+      for(size_t j=0; j<4; j++)
+        r += m[0][j][k] * m[1][i][j];
+      if (m[2][i][k] != r)
+        return false;
+    }
+  return true;
+}
+
+// vertex shading throughput, one vertex or a group of lanes per run of the shader
+template<typename Shading, typename Context>
+static void
+vertices(Context& context, size_t count) {
+  using Program = ::gl::Link<float, Transform, Fragment, ::gl::sl::precision_highp, ::gl::storage_native, Shading>;
+  using vec3 = typename Program::vec3;
+  using mat4 = typename Program::mat4;
+
+  auto position = new vec3[count];
+  auto normal = new vec3[count];
+  mat4 matrix = {
+    {0.8, 0.1, 0.0, 0.0},
+    {-0.1, 0.8, 0.2, 0.0},
+    {0.0, -0.2, 0.7, -1.0},
+    {0.1, 0.2, -3.0, 3.0}
+  };
+
+  for(size_t i=0; i<count; i++) {
+    position[i] = vec3 {float(i % 7), float(i % 11), float(i % 13)} * 0.1f;
+    normal[i] = vec3 {1.0f, float(i % 3), float(i % 5)};
+  }
+
+  Program prog(count);
+  prog.uniform.set("matrix"_s, &matrix);
+  prog.attribute.set("position"_s, position);
+  prog.attribute.set("normal"_s, normal);
+
+  auto t0 = ::std::chrono::steady_clock::now();
+  context.feedback(prog);
+  ::std::chrono::duration<double> t = ::std::chrono::steady_clock::now() - t0;
+
+  ::std::printf("%6zu %12.0f\n", Program::LANES, count / t.count());
+
+  delete[] position;
+  delete[] normal;
+}
+
+int
+main(int argc, char **argv) {
+  const size_t width = 512, height = 512;
+  size_t count = argc > 1 ? ::std::strtoul(argv[1], nullptr, 10) : 10000;
+
+  if (!check_product()) {
+    ::std::fprintf(stderr, "mat4 product is wrong on unaligned operands\n");
+    return 1;
+  }
+
+  using Program = ::gl::Link<float, Vertex, Fragment>;
+  using vec2 = typename Program::vec2;
+  using vec3 = typename Program::vec3;
+
+  auto buffer = (unsigned char (*)[4])::std::calloc(width * height, 4);
+  auto position = new vec2[3 * count];
+  auto color = new vec3[3 * count];
+
+  Program prog(3 * count);
+  prog.attribute.set("position"_s, position);
+  prog.attribute.set("aColor"_s, color);
+
+  ::gl::Context context(width, height, buffer);
+
+  ::std::printf("%6s %12s\n", "pixels", "triangles/s");
+
+  for(unsigned area=1; area<=16; area*=2) {
+    float leg = ::std::sqrt(2.0f * area);
+    ::std::srand(area);
+
+    for(size_t i=0; i<count; i++) {
+      float x = float(::std::rand()) / RAND_MAX * (width - 8);
+      float y = float(::std::rand()) / RAND_MAX * (height - 8);
+      vec2 p[3] = {{x, y}, {x + leg, y}, {x, y + leg}};
+
+      for(size_t k=0; k<3; k++) {
+        position[3*i+k] = p[k] / vec2 {float(width), float(height)} * 2.0f - 1.0f;
+        color[3*i+k] = vec3 {float(k == 0), float(k == 1), float(k == 2)};
+      }
+    }
+
+    for(size_t i=0; i<3*count; i++)
+      context.shade(prog, i, i);
+
+    auto t0 = ::std::chrono::steady_clock::now();
+    ::gl::triangles(context, prog, ::gl::ID{3 * count});
+    ::std::chrono::duration<double> t = ::std::chrono::steady_clock::now() - t0;
+
+    ::std::printf("%6u %12.0f\n", area, count / t.count());
+  }
+
+  ::std::printf("\n%6s %12s\n", "lanes", "vertices/s");
+  vertices<::gl::vertex_scalar>(context, 3 * count);
+  vertices<::gl::vertex_simd>(context, 3 * count);
+
+  delete[] position;
+  delete[] color;
+  ::std::free(buffer);
+  return 0;
+}
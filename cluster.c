@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "cluster.h"
+#include "trace.h"
+
+extern const size_t width;
+extern const size_t height;
+
+bool format_rgb565(void);
+void draw_band(void *buffer, size_t y0, size_t y1);
+
+struct node {
+  int fd;
+  size_t y0, y1;
+  double rate;
+  size_t received;
+  struct cluster_reply reply;
+};
+
+static struct node nodes[CLUSTER_NODES];
+static size_t count;
+static uint32_t frame;
+
+static size_t
+pixel_size(void) {
+  return format_rgb565() ? 2 : 4;
+}
+
+static bool
+send_all(int fd, const void *data, size_t size) {
+  for(const char *p = data; size > 0; ) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool
+recv_all(int fd, void *data, size_t size) {
+  for(char *p = data; size > 0; ) {
+    ssize_t n = recv(fd, p, size, 0);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void
+no_delay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/* connects to, or with listen set binds, address; -1 on failure */
+static int
+open_socket(const char *address, bool listen) {
+  if (strncmp(address, "unix:", 5) == 0) {
+    struct sockaddr_un sun = { .sun_family = AF_UNIX };
+    if (strlen(address + 5) >= sizeof(sun.sun_path))
+      return -1;
+    strcpy(sun.sun_path, address + 5);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return -1;
+    if (listen)
+      unlink(sun.sun_path);
+    if ((listen ? bind(fd, (struct sockaddr *)&sun, sizeof(sun)) : connect(fd, (struct sockaddr *)&sun, sizeof(sun))) < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  const char *colon = strrchr(address, ':');
+  if (!colon)
+    return -1;
+
+  char host[256];
+  size_t n = colon - address;
+  if (n >= sizeof(host))
+    return -1;
+  memcpy(host, address, n);
+  host[n] = 0;
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = listen ? AI_PASSIVE : 0 };
+  struct addrinfo *info;
+  if (getaddrinfo((n == 0 || strcmp(host, "*") == 0) ? NULL : host, colon + 1, &hints, &info) != 0)
+    return -1;
+
+  int fd = -1;
+  for(struct addrinfo *a = info; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    int one = 1;
+    if (listen)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if ((listen ? bind(fd, a->ai_addr, a->ai_addrlen) : connect(fd, a->ai_addr, a->ai_addrlen)) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  freeaddrinfo(info);
+  if (fd >= 0)
+    no_delay(fd);
+  return fd;
+}
+
+/* answers requests on fd until the compositor hangs up or sends a bad one */
+static void
+serve(int fd) {
+  size_t size = width*height*pixel_size();
+  char *buffer = aligned_alloc(64, (size + 63) / 64 * 64);
+  struct cluster_request request;
+
+  while(buffer && recv_all(fd, &request, sizeof(request))) {
+    if (request.magic != CLUSTER_MAGIC || request.width != width || request.height != height ||
+        request.pixel != pixel_size() || request.y0 >= request.y1 || request.y1 > height) {
+      fprintf(stderr, "cluster: request does not match this worker\n");
+      break;
+    }
+
+    TRACE_BEGIN(band_begin);
+    draw_band(buffer, request.y0, request.y1);
+    TRACE_END(band_begin, "band");
+
+    struct cluster_reply reply = { request.frame, request.y0, request.y1 };
+    size_t row = width*pixel_size();
+    if (!send_all(fd, &reply, sizeof(reply)) ||
+        !send_all(fd, buffer + (height - request.y1)*row, (request.y1 - request.y0)*row))
+      break;
+  }
+
+  free(buffer);
+  close(fd);
+}
+
+bool
+cluster_serve(const char *address) {
+  int fd = open_socket(address, true);
+  if (fd < 0 || listen(fd, 1) < 0) {
+    perror(address);
+    return false;
+  }
+
+  for(;;) {
+    int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client < 0) {
+      perror("accept");
+      return false;
+    }
+    no_delay(client);
+    serve(client);
+  }
+}
+
+static bool
+add_node(int fd) {
+  if (fd < 0 || count == CLUSTER_NODES)
+    return false;
+  nodes[count++] = (struct node) { .fd = fd, .rate = 1.0 };
+  return true;
+}
+
+/* forks a worker serving one end of a socket pair */
+static bool
+fork_node(void) {
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0)
+    return false;
+
+  pid_t pid = fork();
+  if (pid < 0)
+    return false;
+
+  if (pid == 0) {
+    for(size_t i=0; i<count; i++)
+      close(nodes[i].fd);
+    close(pair[0]);
+    serve(pair[1]);
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(pair[1]);
+  return add_node(pair[0]);
+}
+
+/* splits the rows by rate, at least CLUSTER_ROWS each */
+static void
+balance(void) {
+  double total = 0.0, sum = 0.0;
+  for(size_t i=0; i<count; i++)
+    total += nodes[i].rate;
+
+  size_t y = 0;
+  for(size_t i=0; i<count; i++) {
+    sum += nodes[i].rate;
+
+    size_t end = (size_t)(height * sum / total / CLUSTER_ROWS + 0.5) * CLUSTER_ROWS;
+    size_t lo = y + CLUSTER_ROWS, hi = height - (count - 1 - i) * CLUSTER_ROWS;
+    if (i == count - 1 || end > hi)
+      end = hi;
+    if (end < lo)
+      end = lo;
+
+    nodes[i].y0 = y;
+    nodes[i].y1 = end;
+    y = end;
+  }
+}
+
+size_t
+cluster_init(const char *workers) {
+  char *list = strdup(workers);
+  bool ok = true;
+
+  for(char *save, *w = strtok_r(list, ",", &save); ok && w; w = strtok_r(NULL, ",", &save)) {
+    if (strncmp(w, "fork:", 5) == 0)
+      for(long n = strtol(w + 5, NULL, 10); ok && n > 0; n--)
+        ok = fork_node();
+    else
+      ok = add_node(open_socket(w, false));
+
+    if (!ok)
+      fprintf(stderr, "cluster: cannot reach %s\n", w);
+  }
+
+  free(list);
+  if (ok && count > 0 && count <= height / CLUSTER_ROWS) {
+    balance();
+    return count;
+  }
+
+  for(size_t i=0; i<count; i++)
+    close(nodes[i].fd);
+  count = 0;
+  return 0;
+}
+
+void
+cluster_draw(void *buffer) {
+  TRACE_BEGIN(cluster_begin);
+  size_t row = width*pixel_size();
+  struct pollfd fds[CLUSTER_NODES];
+
+  frame++;
+  for(size_t i=0; i<count; i++) {
+    struct cluster_request request = {
+      CLUSTER_MAGIC, width, height, pixel_size(), frame, nodes[i].y0, nodes[i].y1
+    };
+
+    if (!send_all(nodes[i].fd, &request, sizeof(request))) {
+      fprintf(stderr, "cluster: worker %zu hung up\n", i);
+      exit(EXIT_FAILURE);
+    }
+    nodes[i].received = 0;
+    fds[i] = (struct pollfd) { .fd = nodes[i].fd, .events = POLLIN };
+  }
+
+  uint64_t begin = trace_now();
+
+  for(size_t pending = count; pending > 0; ) {
+    if (poll(fds, count, -1) < 0)
+      continue;
+
+    for(size_t i=0; i<count; i++) {
+      struct node *node = &nodes[i];
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+
+      /* reply header, then straight into the band's rows */
+      size_t header = sizeof(node->reply), band = (node->y1 - node->y0)*row;
+      ssize_t n = (node->received < header)
+        ? recv(node->fd, (char *)&node->reply + node->received, header - node->received, 0)
+        : recv(node->fd, (char *)buffer + (height - node->y1)*row + node->received - header, header + band - node->received, 0);
+
+      if (n <= 0 || (node->received < header && node->received + n == header &&
+                     (node->reply.frame != frame || node->reply.y0 != node->y0 || node->reply.y1 != node->y1))) {
+        fprintf(stderr, "cluster: worker %zu failed\n", i);
+        exit(EXIT_FAILURE);
+      }
+
+      node->received += n;
+      if (node->received < header + band)
+        continue;
+
+      /* rows per nanosecond, smoothed over frames */
+      double rate = (double)(node->y1 - node->y0) / (double)(trace_now() - begin + 1);
+      node->rate = (frame == 1) ? rate : 0.75 * node->rate + 0.25 * rate;
+      fds[i].fd = -1;
+      pending--;
+    }
+  }
+
+  balance();
+  TRACE_END(cluster_begin, "cluster");
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sort-first rendering over sockets. The compositor splits the frame into
+ * bands of rows, one per worker, and each frame sends every worker a
+ * cluster_request. The worker renders its band with draw_band and answers
+ * with a cluster_reply followed by the band's rows, top row first. Band
+ * bounds are multiples of CLUSTER_ROWS and move towards the workers that
+ * finished their last bands sooner.
+ *
+ * Workers are given as a comma separated list of "unix:PATH",
+ * "HOST:PORT" or "fork:N", the last starting N local workers connected
+ * by socket pairs. Messages are in host byte order.
+ */
+
+#define CLUSTER_MAGIC 0x31495254
+#define CLUSTER_NODES 64
+#define CLUSTER_ROWS 16
+
+struct cluster_request {
+  uint32_t magic;
+  uint32_t width;
+  uint32_t height;
+  uint32_t pixel;
+  uint32_t frame;
+  uint32_t y0;
+  uint32_t y1;
+};
+
+struct cluster_reply {
+  uint32_t frame;
+  uint32_t y0;
+  uint32_t y1;
+};
+
+size_t cluster_init(const char *workers);
+void cluster_draw(void *buffer);
+bool cluster_serve(const char *address);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+  extern const size_t width = 512;
+  extern const size_t height = 512;
+
+  void draw_sse2(void *buffer, size_t y0, size_t y1, float scale);
+  void draw_avx2(void *buffer, size_t y0, size_t y1, float scale);
+  void draw_avx512(void *buffer, size_t y0, size_t y1, float scale);
+}
+
+typedef void Draw(void *buffer, size_t y0, size_t y1, float scale);
+
+static bool
+has_sse2() {
+  return true;
+}
+
+static bool
+has_avx2() {
+  return __builtin_cpu_supports("avx2")
+    && __builtin_cpu_supports("fma")
+    && __builtin_cpu_supports("f16c");
+}
+
+static bool
+has_avx512() {
+  return has_avx2()
+    && __builtin_cpu_supports("avx512f")
+    && __builtin_cpu_supports("avx512vl")
+    && __builtin_cpu_supports("avx512dq")
+    && __builtin_cpu_supports("avx512bw");
+}
+
+static const struct {
+  const char *name;
+  Draw *draw;
+  bool (*supported)();
+} levels[] = {
+  { "avx512", draw_avx512, has_avx512 },
+  { "avx2",   draw_avx2,   has_avx2   },
+  { "sse2",   draw_sse2,   has_sse2   },
+};
+
+static Draw *
+choose() {
+  __builtin_cpu_init();
+
+  if (const char *force = ::std::getenv("TRIANGLE_ISA")) {
+    for (auto& l : levels) {
+      if (strcmp(force, l.name) != 0)
+        continue;
+      if (l.supported()) {
+        ::std::fprintf(stderr, "isa: %s\n", l.name);
+        return l.draw;
+      }
+      ::std::fprintf(stderr, "isa: %s not supported, ignoring TRIANGLE_ISA\n", l.name);
+      break;
+    }
+  }
+
+  for (auto& l : levels)
+    if (l.supported())
+      return l.draw;
+  return draw_sse2;
+}
+
+static bool&
+rgb565() {
+  static bool rgb565 = [] {
+    const char *format = ::std::getenv("TRIANGLE_FORMAT");
+    return format && strcmp(format, "rgb565") == 0;
+  }();
+  return rgb565;
+}
+
+extern "C" bool
+format_rgb565() {
+  return rgb565();
+}
+
+// for when the compositor does not support RGB565
+extern "C" void
+set_format_rgb565(bool enable) {
+  rgb565() = enable;
+}
+
+static Draw *
+impl() {
+  static Draw *draw = choose();
+  return draw;
+}
+
+// frame time budget in seconds from TRIANGLE_BUDGET in milliseconds, 0 if unset
+static double
+budget() {
+  const char *ms = ::std::getenv("TRIANGLE_BUDGET");
+  return ms ? ::std::strtod(ms, nullptr) / 1000.0 : 0.0;
+}
+
+// Render cost is taken to grow with the pixel count. The scale drops at once to
+// fit 90% of the budget, but grows at most 5% a frame so that it settles.
+static float
+next_scale(float scale, double elapsed, double budget) {
+  float s = scale * float(::std::sqrt(0.9 * budget / ::std::max(elapsed, 1e-6)));
+  return ::std::clamp(::std::min(s, scale * 1.05f), 0.25f, 1.0f);
+}
+
+extern "C" void
+draw_band(void *buffer, size_t y0, size_t y1) {
+  impl()(buffer, y0, y1, 1.0f);
+}
+
+extern "C" void
+draw(void *buffer) {
+  static double limit = budget();
+  static float scale = 1.0f;
+
+  if (limit <= 0.0) {
+    impl()(buffer, 0, height, 1.0f);
+    return;
+  }
+
+  auto t0 = ::std::chrono::steady_clock::now();
+  impl()(buffer, 0, height, scale);
+  ::std::chrono::duration<double> t = ::std::chrono::steady_clock::now() - t0;
+  scale = next_scale(scale, t.count(), limit);
+}
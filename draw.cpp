@@ -1,9 +1,15 @@
 #include <cstring>
+#include <cstdlib>
 #include "gl.hpp"
+#include "mesh.h"
+
+#define DRAW_ISA(isa) DRAW_ISA_(isa)
+#define DRAW_ISA_(isa) draw_##isa
 
 extern "C" {
-  extern const size_t width = 512;
-  extern const size_t height = 512;
+  extern const size_t width;
+  extern const size_t height;
+  bool format_rgb565();
 }
 
 template<typename T>
@@ -19,18 +25,27 @@ perspective(T fovy, T aspect, T near, T far) {
   };
 }
 
+namespace {
+
+template<typename T>
+struct Camera {
+  UNIFORM_BLOCK(Camera, T);
+
+  FIELD(perspective, mat4);
+};
+
 template<typename T>
 struct Vertex {
   VERTEX_SHADER(Vertex, T);
 
-  UNIFORM(perspective, mat4);
+  UNIFORM(camera, Camera<Float>);
   ATTRIBUTE(position, vec3);
   ATTRIBUTE(aColor, vec3);
   VARYING(vColor, vec3);
 
   void
   main() {
-    gl_Position = perspective * vec4(position, 1.0);
+    gl_Position = camera.perspective * vec4(position, 1.0);
     vColor = aColor;
   }
 };
@@ -47,18 +62,83 @@ struct Fragment {
   }
 };
 
+}
 
-extern "C" void
-draw(unsigned char buffer[][4]) {
-  memset(buffer, 0, sizeof(unsigned char)*height*width*4);
 
-  using Program = ::gl::Link<float, Vertex, Fragment>;
+static ::gl::Heatmap
+heatmap_mode() {
+  const char *mode = ::std::getenv("TRIANGLE_HEATMAP");
+
+  if (!mode)
+    return ::gl::heatmap_off;
+  if (strcmp(mode, "overdraw") == 0)
+    return ::gl::heatmap_overdraw;
+  if (strcmp(mode, "tests") == 0)
+    return ::gl::heatmap_tests;
+  if (strcmp(mode, "shaded") == 0)
+    return ::gl::heatmap_shaded;
+  return ::gl::heatmap_off;
+}
+
+static struct mesh *
+scene_mesh() {
+  static struct mesh mesh;
+  const char *path = ::std::getenv("TRIANGLE_MESH");
+
+  if (!path || !mesh_open(&mesh, path))
+    return nullptr;
+  return &mesh;
+}
+
+static bool
+tiled() {
+  return ::std::getenv("TRIANGLE_TILED") != nullptr;
+}
+
+static bool
+deferred() {
+  return ::std::getenv("TRIANGLE_DEFERRED") != nullptr;
+}
+
+static bool
+cached() {
+  return ::std::getenv("TRIANGLE_CACHE") != nullptr;
+}
+
+static size_t
+stream_batch() {
+  const char *batch = ::std::getenv("TRIANGLE_BATCH");
+  return batch ? (::std::strtoul(batch, nullptr, 10) + 2) / 3 * 3 : 0;
+}
+
+// renders rows y0 to y1, counting up from the bottom, of a w x h frame
+template<typename Format>
+static void
+render(typename Format::Pixel *buffer, size_t w, size_t h, size_t y0, size_t y1) {
+  static ::gl::Heatmap heatmap = heatmap_mode();
+  static struct mesh *mesh = scene_mesh();
+  static size_t batch = stream_batch();
+  static bool tiles = tiled();
+  static bool resolve = deferred();
+  static bool keep = cached();
+  static ::gl::TileCache<Format> cache;
+  static ::gl::HeatBuffer heat;
+
+  // resolve_tiles writes every row of the band
+  if (!tiles)
+    memset(buffer + (h-y1)*w, 0, sizeof(typename Format::Pixel)*(y1-y0)*w);
+
+  using Program = ::gl::Link<float, Vertex, Fragment, ::gl::sl::precision_highp, ::gl::storage_native, ::gl::vertex_simd>;
   using T = typename Program::Float;
   using vec3 = typename Program::vec3;
 
-  Program prog(3);
+  vec3 *mesh_position = mesh ? ::gl::mesh::attribute<vec3>(*mesh, "position") : nullptr;
+  vec3 *mesh_color = mesh ? ::gl::mesh::attribute<vec3>(*mesh, "color") : nullptr;
+  bool indexed = mesh_position && mesh_color;
 
-  auto p = perspective<T>(::gl::sl::radians(90.0), T(width)/T(height), 0.1, 100.0);
+  Program prog(!indexed ? 3 : batch ? 2 * batch : mesh->header->vertices);
+
+  static Camera<T> camera = { perspective<T>(::gl::sl::radians(90.0), T(width)/T(height), 0.1, 100.0) };
 
   vec3 position[] = {
     {-0.5, -0.5, -1.0},
@@ -72,9 +152,65 @@ draw(unsigned char buffer[][4]) {
     {0.0, 0.0, 1.0}
   };
 
-  prog.uniform.set("perspective"_s, &p);
-  prog.attribute.set("position"_s, position);
-  prog.attribute.set("aColor"_s, color);
+  prog.uniform.set("camera"_s, &camera);
+  prog.attribute.set("position"_s, indexed ? mesh_position : position);
+  prog.attribute.set("aColor"_s, indexed ? mesh_color : color);
+
+  ::gl::Context<Format> context(w, h, buffer);
+  context.set_heatmap(heatmap, &heat);
+  context.set_tiled(tiles);
+  if (keep)
+    context.set_cache(&cache);
+  context.set_deferred(resolve);
+  context.set_band(y0, y1);
+  auto const& transform = prog.uniform.get("camera"_s)->perspective;
+
+  if (indexed && batch)
+    context.stream(prog, ::gl::mesh::indices(*mesh), ::gl::triangles);
+  else if (indexed)
+    context.draw(prog, ::gl::mesh::indices(*mesh), ::gl::triangles, transform, ::gl::Box<T> {
+        {mesh->header->lo[0], mesh->header->lo[1], mesh->header->lo[2]},
+        {mesh->header->hi[0], mesh->header->hi[1], mesh->header->hi[2]}
+      });
+  else
+    context.draw(prog, ::gl::triangles, transform, ::gl::Box<T> {{-0.5, -0.5, -5.0}, {0.5, 0.5, -1.0}});
+  context.resolve_heatmap();
+  context.resolve_tiles();
+
+#ifdef GL_STATISTICS
+  static unsigned frame = 0;
+  if ((frame++ % 60) == 0)
+    ::gl::stats::print(stderr, context.frame_statistics);
+#endif
+}
+
+// renders at scale times the surface size, then upscales into buffer
+template<typename Format>
+static void
+present(typename Format::Pixel *buffer, size_t y0, size_t y1, float scale) {
+  using Pixel = typename Format::Pixel;
+
+  if (scale >= 1.0f) {
+    render<Format>(buffer, width, height, y0, y1);
+    return;
+  }
+
+  static Pixel *low = (Pixel *)::std::aligned_alloc(64, (sizeof(Pixel)*width*height + 63) / 64 * 64);
+  size_t w = ::std::max(size_t(float(width) * scale + 0.5f), size_t(1));
+  size_t h = ::std::max(size_t(float(height) * scale + 0.5f), size_t(1));
 
-  ::gl::Context(width, height, buffer).draw(prog, ::gl::triangles);
+  // the rows the filter reads for the band, with one to spare on each side
+  size_t ly0 = y0 * h / height, ly1 = ::std::min((y1 * h + height - 1) / height + 1, h);
+  ly0 = (ly0 > 0) ? ly0 - 1 : 0;
+
+  render<Format>(low, w, h, ly0, ly1);
+  ::gl::upscale<Format>(low, w, h, buffer, width, height, height - y1, height - y0);
+}
+
+extern "C" void
+DRAW_ISA(GL_ISA)(void *buffer, size_t y0, size_t y1, float scale) {
+  if (format_rgb565())
+    present<::gl::RGB565>((::gl::RGB565::Pixel *)buffer, y0, y1, scale);
+  else
+    present<::gl::XRGB8888>((::gl::XRGB8888::Pixel *)buffer, y0, y1, scale);
 }
@@ -0,0 +1,217 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include "sl.hpp"
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
+namespace gl {
+  inline namespace GL_ISA {
+  using namespace sl;
+
+  // Framebuffer formats. store() converts up to four horizontally adjacent
+  // pixels at once, writing dst[i] for each bit i set in mask; load() reads
+  // one pixel back.
+
+  // 8 bit unorm, bytes b g r a; the compositor ignores a
+  struct XRGB8888 {
+    using Pixel = unsigned char[4];
+
+    static
+    void
+    store(Pixel *dst, vec<4,float> const color[4], unsigned mask) {
+#ifdef __SSE2__
+      __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(255.0f);
+      __m128i p[4];
+
+      for(size_t i=0; i<4; i++) {
+        __m128 c = color[i].packet();
+        c = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,0,1,2));
+        p[i] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(c, one), zero), one));
+      }
+
+      __m128i w = _mm_packus_epi16(_mm_packs_epi32(p[0], p[1]), _mm_packs_epi32(p[2], p[3]));
+
+      if (mask == 0xf) {
+        _mm_storeu_si128((__m128i *)dst, w);
+        return;
+      }
+
+      alignas(16) Pixel packed[4];
+      _mm_store_si128((__m128i *)packed, w);
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i))
+          ::std::memcpy(dst[i], packed[i], sizeof(Pixel));
+#else
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i)) {
+          vec<4,float> c = clamp(color[i], 0.0f, 1.0f) * 255.0f;
+          dst[i][0] = c.b;
+          dst[i][1] = c.g;
+          dst[i][2] = c.r;
+          dst[i][3] = c.a;
+        }
+#endif
+    }
+
+    static
+    vec<4,float>
+    load(Pixel const& src) {
+      return vec<4,float> {float(src[2]), float(src[1]), float(src[0]), float(src[3])} * (1.0f / 255.0f);
+    }
+  };
+
+  // r in bits 15-11, g in 10-5, b in 4-0, rounded to nearest
+  struct RGB565 {
+    using Pixel = ::std::uint16_t;
+
+    static
+    void
+    store(Pixel *dst, vec<4,float> const color[4], unsigned mask) {
+#ifdef __SSE2__
+      __m128 r = color[0].packet(), g = color[1].packet(), b = color[2].packet(), a = color[3].packet();
+      _MM_TRANSPOSE4_PS(r, g, b, a);
+
+      __m128 zero = _mm_setzero_ps(), m5 = _mm_set1_ps(31.0f), m6 = _mm_set1_ps(63.0f);
+      __m128i ri = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(r, m5), zero), m5));
+      __m128i gi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(g, m6), zero), m6));
+      __m128i bi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(b, m5), zero), m5));
+      __m128i v = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ri, 11), _mm_slli_epi32(gi, 5)), bi);
+
+      // no unsigned 32 to 16 bit pack before SSE4.1, so bias into signed range
+      __m128i bias = _mm_set1_epi32(0x8000);
+      __m128i w = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(v, bias), _mm_setzero_si128()), _mm_set1_epi16(-0x8000));
+
+      if (mask == 0xf) {
+        _mm_storel_epi64((__m128i *)dst, w);
+        return;
+      }
+
+      alignas(16) Pixel packed[8];
+      _mm_store_si128((__m128i *)packed, w);
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i))
+          dst[i] = packed[i];
+#else
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i)) {
+          vec<4,float> c = clamp(color[i], 0.0f, 1.0f) * vec<4,float> {31.0f, 63.0f, 31.0f, 0.0f};
+          dst[i] = Pixel((::std::lrint(c.r) << 11) | (::std::lrint(c.g) << 5) | ::std::lrint(c.b));
+        }
+#endif
+    }
+
+    static
+    vec<4,float>
+    load(Pixel const& src) {
+      return {float(src >> 11) * (1.0f / 31.0f), float((src >> 5) & 63) * (1.0f / 63.0f), float(src & 31) * (1.0f / 31.0f), 1.0f};
+    }
+  };
+
+  // IEEE binary16 per channel, unclamped
+  struct RGBA16F {
+    using Pixel = half[4];
+
+    static
+    void
+    store(Pixel *dst, vec<4,float> const color[4], unsigned mask) {
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i)) {
+#ifdef __F16C__
+          _mm_storel_epi64((__m128i *)dst[i], _mm_cvtps_ph(color[i].packet(), _MM_FROUND_TO_NEAREST_INT));
+#else
+          for(size_t k=0; k<4; k++)
+            dst[i][k] = color[i][k];
+#endif
+        }
+    }
+
+    static
+    vec<4,float>
+    load(Pixel const& src) {
+      return {float(src[0]), float(src[1]), float(src[2]), float(src[3])};
+    }
+  };
+
+  // red channel only, unclamped
+  struct R32F {
+    using Pixel = float;
+
+    static
+    void
+    store(Pixel *dst, vec<4,float> const color[4], unsigned mask) {
+#ifdef __SSE2__
+      if (mask == 0xf) {
+        __m128 r = color[0].packet(), g = color[1].packet(), b = color[2].packet(), a = color[3].packet();
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst, r);
+        return;
+      }
+#endif
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i))
+          dst[i] = color[i].r;
+    }
+
+    static
+    vec<4,float>
+    load(Pixel const& src) {
+      return {src, 0.0f, 0.0f, 1.0f};
+    }
+  };
+
+  // Encodes linear r g b to sRGB before storing as F. The transfer function
+  // is looked up in a table of 4096 linear steps instead of calling pow per
+  // channel; the coarsest step is under one 8 bit code near black.
+  template<typename F>
+  struct srgb : F {
+    using Pixel = typename F::Pixel;
+
+    static constexpr size_t STEPS = 4096;
+
+    struct Table {
+      float value[STEPS];
+
+      Table() {
+        for(size_t i=0; i<STEPS; i++) {
+          double l = double(i) / double(STEPS - 1);
+          value[i] = float((l <= 0.0031308) ? 12.92 * l : 1.055 * ::std::pow(l, 1.0 / 2.4) - 0.055);
+        }
+      }
+    };
+
+    static
+    float
+    encode(float l) {
+      static const Table table;
+      return table.value[(l > 0.0f) ? size_t(min(l, 1.0f) * float(STEPS - 1) + 0.5f) : 0];
+    }
+
+    static
+    void
+    store(Pixel *dst, vec<4,float> const color[4], unsigned mask) {
+      vec<4,float> c[4];
+      for(size_t i=0; i<4; i++)
+        if (mask & (1u << i))
+          c[i] = {encode(color[i].r), encode(color[i].g), encode(color[i].b), color[i].a};
+      F::store(dst, c, mask);
+    }
+
+    static
+    float
+    decode(float e) {
+      return (e <= 0.04045f) ? e / 12.92f : ::std::pow((e + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static
+    vec<4,float>
+    load(Pixel const& src) {
+      vec<4,float> c = F::load(src);
+      return {decode(c.r), decode(c.g), decode(c.b), c.a};
+    }
+  };
+  }
+}
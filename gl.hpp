@@ -1,8 +1,24 @@
 #pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <typeinfo>
 #include "sl.hpp"
+#include "format.hpp"
+#include "texture.hpp"
 #include "shader.hpp"
+#include "stats.hpp"
+#include "trace.h"
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
 
 namespace gl {
+  inline namespace GL_ISA {
   using namespace sl;
 
   template<typename T>
@@ -17,126 +33,1379 @@ namespace gl {
     return all(lessThan(vec<4,T>{ area2(u,v,box[0]), area2(u,v,box[1]), area2(u,v,box[2]), area2(u,v,box[3]) }, {0.0}));
   }
 
+  template<typename T>
+  bool
+  inside(vec<2,T> const& u, vec<2,T> const& v, vec<2,T> box[4]) {
+    return all(greaterThan(vec<4,T>{ area2(u,v,box[0]), area2(u,v,box[1]), area2(u,v,box[2]), area2(u,v,box[3]) }, {0.0}));
+  }
+
+  // area2(u,v,p) at the 16 pixel centers of the 4x4 window at (bx,by), one row per vector
+  template<typename T>
+  void
+  edge(vec<2,T> const& u, vec<2,T> const& v, size_t bx, size_t by, vec<4,T> e[4]) {
+    vec<2,T> d = v - u;
+    vec<4,T> x = vec<4,T> {T(bx+0.5), T(bx+1.5), T(bx+2.5), T(bx+3.5)} - u.x;
+
+    for(size_t r=0; r<4; r++)
+      e[r] = vec<4,T>(d.x * (T(by+r+0.5) - u.y)) - x * d.y;
+  }
+
+  // bit 4*r+i is set when pixel i of row r is strictly inside all three edges
+  template<typename T>
+  unsigned
+  coverage(vec<4,T> const e[3][4]) {
+    unsigned mask = 0;
+    for(size_t r=0; r<4; r++) {
+#ifdef __SSE2__
+      if constexpr (vec<4,T>::PACKET) {
+        __m128 zero = _mm_setzero_ps();
+        __m128 m = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(e[0][r].packet(), zero), _mm_cmpgt_ps(e[1][r].packet(), zero)), _mm_cmpgt_ps(e[2][r].packet(), zero));
+        mask |= unsigned(_mm_movemask_ps(m)) << (4*r);
+        continue;
+      }
+#endif
+      for(size_t i=0; i<4; i++)
+        mask |= unsigned(e[0][r][i] > T(0.0) && e[1][r][i] > T(0.0) && e[2][r][i] > T(0.0)) << (4*r+i);
+    }
+    return mask;
+  }
+
+  template<typename T>
+  struct Box {
+    vec<3,T> lo, hi;
+  };
+
+  template<typename T>
+  struct Sphere {
+    vec<3,T> center;
+    T radius;
+  };
+
+  // planes of the clip volume -w <= x,y,z <= w, as object space half-spaces of m
+  template<typename T>
+  void
+  frustum(mat<4,T> const& m, vec<4,T> planes[6]) {
+    vec<4,T> x = {m[0][0], m[1][0], m[2][0], m[3][0]};
+    vec<4,T> y = {m[0][1], m[1][1], m[2][1], m[3][1]};
+    vec<4,T> z = {m[0][2], m[1][2], m[2][2], m[3][2]};
+    vec<4,T> w = {m[0][3], m[1][3], m[2][3], m[3][3]};
+
+    planes[0] = w + x;
+    planes[1] = w - x;
+    planes[2] = w + y;
+    planes[3] = w - y;
+    planes[4] = w + z;
+    planes[5] = w - z;
+  }
+
+  template<typename T>
+  bool
+  visible(mat<4,T> const& m, Box<T> const& b) {
+    vec<4,T> planes[6];
+    frustum(m, planes);
+
+    for(auto const& p : planes) {
+      vec<3,T> v = {p.x > T(0.0) ? b.hi.x : b.lo.x, p.y > T(0.0) ? b.hi.y : b.lo.y, p.z > T(0.0) ? b.hi.z : b.lo.z};
+      if (dot(vec<3,T>(p), v) + p.w < T(0.0))
+        return false;
+    }
+    return true;
+  }
+
+  template<typename T>
+  bool
+  visible(mat<4,T> const& m, Sphere<T> const& s) {
+    vec<4,T> planes[6];
+    frustum(m, planes);
+
+    for(auto const& p : planes) {
+      vec<3,T> n = p;
+      if (dot(n, s.center) + p.w < -s.radius * length(n))
+        return false;
+    }
+    return true;
+  }
+
+  enum Heatmap {
+    heatmap_off,
+    heatmap_overdraw,
+    heatmap_tests,
+    heatmap_shaded
+  };
+
+  // copies n bytes with non-temporal stores where both sides are 16 byte aligned
+  inline
+  void
+  stream_copy(void *dst, void const *src, size_t n) {
+    auto d = (char *)dst;
+    auto s = (char const *)src;
+#ifdef __SSE2__
+    if (((::std::uintptr_t)d | (::std::uintptr_t)s) % 16 == 0)
+      for(; n >= 16; n -= 16, d += 16, s += 16)
+        _mm_stream_si128((__m128i *)d, _mm_load_si128((__m128i const *)s));
+#endif
+    ::std::memcpy(d, s, n);
+  }
+
+  // zeroes n bytes with non-temporal stores where dst is 16 byte aligned
+  inline
+  void
+  stream_zero(void *dst, size_t n) {
+    auto d = (char *)dst;
+#ifdef __SSE2__
+    if ((::std::uintptr_t)d % 16 == 0)
+      for(; n >= 16; n -= 16, d += 16)
+        _mm_stream_si128((__m128i *)d, _mm_setzero_si128());
+#endif
+    ::std::memset(d, 0, n);
+  }
+
+  template<typename Format = XRGB8888>
+  struct Context;
+
+  // max depth pyramid; level k texels cover 2^(k+1) pixels square
+  struct HiZ {
+    static constexpr size_t LEVELS = 16;
+
+    size_t width = 0, height = 0;
+    size_t levels = 0;
+    size_t w[LEVELS], h[LEVELS];
+    float *level[LEVELS] = {};
+
+    HiZ() = default;
+    HiZ(HiZ const&) = delete;
+
+    ~HiZ() {
+      for(size_t k=0; k<levels; k++)
+        ::std::free(level[k]);
+    }
+
+    template<typename Format>
+    void build(Context<Format> const& context);
+
+    float
+    depth(size_t k, size_t x0, size_t y0, size_t x1, size_t y1) const {
+      float d = 0.0f;
+      for(size_t y=y0; y<=y1; y++)
+        for(size_t x=x0; x<=x1; x++)
+          d = max(d, level[k][y*w[k]+x]);
+      return d;
+    }
+
+    // conservative: true only if every pixel the bounds may cover has a nearer occluder in this pyramid
+    template<typename T>
+    bool
+    occluded(mat<4,T> const& m, Box<T> const& b) const {
+      if (levels == 0)
+        return false;
+
+      vec<2,T> lo = {T(width), T(height)}, hi = T(0.0);
+      T z = T(1.0);
+
+      for(int i=0; i<8; i++) {
+        vec<4,T> c = m * vec<4,T> {(i & 1) ? b.hi.x : b.lo.x, (i & 2) ? b.hi.y : b.lo.y, (i & 4) ? b.hi.z : b.lo.z, 1.0};
+        if (!(c.w > T(0.0)))
+          return false;
+
+        vec<3,T> p = (vec<3,T>(c) / c.w + T(1.0)) * T(0.5) * vec<3,T> {T(width), T(height), 1.0};
+        lo = min(lo, vec<2,T>(p));
+        hi = max(hi, vec<2,T>(p));
+        z = min(z, p.z);
+      }
+
+      if (hi.x < T(0.0) || hi.y < T(0.0) || lo.x >= T(width) || lo.y >= T(height))
+        return true;
+
+      size_t x0 = size_t(max(lo.x, T(0.0))), x1 = size_t(min(hi.x, T(width - 1)));
+      size_t y0 = size_t(max(lo.y, T(0.0))), y1 = size_t(min(hi.y, T(height - 1)));
+
+      size_t k = 0;
+      while(k + 1 < levels && (max(x1 - x0, y1 - y0) >> (k + 1)) > 1)
+        ++k;
+
+      return z > T(depth(k, x0 >> (k + 1), y0 >> (k + 1), x1 >> (k + 1), y1 >> (k + 1)));
+    }
+  };
+
+  // Tile pixels and signatures kept across frames. A tile that one draw alone
+  // covered in the last frame is kept when the first draw over it in this frame
+  // has the same signature: program, uniform values, and window positions and
+  // varyings of the triangles binned there, in order. Texture contents are not
+  // part of the signature.
+  template<typename Format>
+  struct TileCache {
+    using Pixel = typename Format::Pixel;
+
+    size_t tiles = 0;
+    Pixel *pixels = nullptr;
+    ::std::uint64_t *last = nullptr, *current = nullptr;
+    unsigned char *last_draws = nullptr, *current_draws = nullptr;
+
+    TileCache() = default;
+    TileCache(TileCache const&) = delete;
+
+    ~TileCache() {
+      resize(0, 0);
+    }
+
+    void
+    resize(size_t n, size_t area) {
+      if (n == tiles)
+        return;
+
+      ::std::free(pixels);
+      ::std::free(last);
+      ::std::free(current);
+      ::std::free(last_draws);
+      ::std::free(current_draws);
+
+      tiles = n;
+      pixels = n ? (Pixel *)::std::aligned_alloc(64, sizeof(Pixel)*area*n) : nullptr;
+      last = n ? (::std::uint64_t *)::std::malloc(sizeof(::std::uint64_t)*n) : nullptr;
+      current = n ? (::std::uint64_t *)::std::malloc(sizeof(::std::uint64_t)*n) : nullptr;
+      last_draws = n ? (unsigned char *)::std::calloc(n, 1) : nullptr;
+      current_draws = n ? (unsigned char *)::std::calloc(n, 1) : nullptr;
+    }
+
+    void
+    next_frame() {
+      ::std::swap(last, current);
+      ::std::swap(last_draws, current_draws);
+      ::std::memset(current_draws, 0, tiles);
+    }
+  };
+
+  // Heatmap counters kept across frames, so that a context per frame does not
+  // allocate them
+  struct HeatBuffer {
+    size_t size = 0;
+    unsigned *counts = nullptr;
+
+    HeatBuffer() = default;
+    HeatBuffer(HeatBuffer const&) = delete;
+
+    ~HeatBuffer() {
+      ::std::free(counts);
+    }
+
+    // false if n counters cannot be allocated
+    bool
+    resize(size_t n) {
+      if (n != size) {
+        ::std::free(counts);
+        counts = (unsigned *)::std::malloc(sizeof(unsigned)*n);
+        size = counts ? n : 0;
+      }
+      return counts != nullptr;
+    }
+  };
+
   struct ID {
+    size_t count;
+
     size_t operator[](size_t n) const { return n; }
+    size_t size() const { return count; }
+  };
+
+  struct Batch {
+    const ::std::uint32_t *local;
+    size_t base;
+    size_t count;
+
+    size_t operator[](size_t n) const { return base + local[n]; }
+    size_t size() const { return count; }
   };
 
+  template<typename Format>
   struct Context {
+    using Pixel = typename Format::Pixel;
+
+    static constexpr size_t TILE = 16;
+
     const size_t width, height;
-    unsigned char (*buffer)[4];
+    Pixel *buffer;
+    GL_STAT(Statistics draw_statistics = {});
+    GL_STAT(Statistics frame_statistics = {});
+    Heatmap heatmap = heatmap_off;
+    unsigned *heat = nullptr;
+    HeatBuffer *heat_buffer = nullptr;
+    float *depth = nullptr;
+    HiZ const *occlusion = nullptr;
+    Pixel *tiles = nullptr;
+    unsigned char *dirty = nullptr;
+    size_t tiles_x = (width + TILE - 1) / TILE, tiles_y = (height + TILE - 1) / TILE;
+    bool deferred = false;
+    size_t band[2];
+    TileCache<Format> *cache = nullptr;
+    unsigned char *kept = nullptr;
+
+    Context(size_t width, size_t height, Pixel *buffer)
+      : width(width), height(height), buffer(buffer), band{0, height} {
+    }
+
+    Context(Context const&) = delete;
+
+    ~Context() {
+      if (!heat_buffer)
+        ::std::free(heat);
+      ::std::free(depth);
+      if (!cache)
+        ::std::free(tiles);
+      ::std::free(dirty);
+      ::std::free(kept);
+    }
+
+    void
+    set_depth(bool enable) {
+      ::std::free(depth);
+      depth = enable ? (float *)::std::malloc(sizeof(float)*width*height) : nullptr;
+      clear_depth();
+    }
+
+    void
+    clear_depth() {
+      if (depth)
+        for(size_t i=0; i<width*height; i++)
+          depth[i] = 1.0f;
+    }
+
+    // Renders into TILE x TILE tiles, each contiguous in memory, instead of buffer.
+    // A tile is cleared to zero when first written; resolve_tiles copies the
+    // written ones to the band's rows of buffer, zeroes the rest of those rows
+    // and ends the frame, so buffer need not be cleared beforehand.
+    void
+    set_tiled(bool enable) {
+      if (!cache)
+        ::std::free(tiles);
+      ::std::free(dirty);
+      ::std::free(kept);
+      cache = nullptr;
+      kept = nullptr;
+      tiles_x = (width + TILE - 1) / TILE;
+      tiles_y = (height + TILE - 1) / TILE;
+      tiles = enable ? (Pixel *)::std::aligned_alloc(64, sizeof(Pixel)*TILE*TILE*tiles_x*tiles_y) : nullptr;
+      dirty = enable ? (unsigned char *)::std::calloc(tiles_x*tiles_y, 1) : nullptr;
+    }
+
+    void
+    resolve_tiles() {
+      if (!tiles)
+        return;
+
+      for(size_t y=band[0]; y<band[1]; y++)
+        for(size_t tx=0; tx<tiles_x; tx++) {
+          size_t t = (y / TILE)*tiles_x + tx;
+          size_t x0 = tx*TILE, w = min(TILE, width - x0);
+
+          if (dirty[t])
+            stream_copy(row(y) + x0, tiles + t*TILE*TILE + (y % TILE)*TILE, sizeof(Pixel)*w);
+          else
+            stream_zero(row(y) + x0, sizeof(Pixel)*w);
+        }
+      ::std::memset(dirty, 0, tiles_x*tiles_y);
+
+#ifdef __SSE2__
+      _mm_sfence();
+#endif
+
+      if (cache)
+        cache->next_frame();
+    }
+
+    // Renders into the cache's tiles, which outlive the context, and skips the
+    // tiles it can keep from the last frame, which end with resolve_tiles.
+    // Draws with a depth buffer or a heatmap are not cached.
+    void
+    set_cache(TileCache<Format> *c) {
+      set_tiled(c != nullptr);
+      if (!c)
+        return;
+
+      ::std::free(tiles);
+      cache = c;
+      cache->resize(tiles_x*tiles_y, TILE*TILE);
+      tiles = cache->pixels;
+      kept = (unsigned char *)::std::calloc(tiles_x*tiles_y, 1);
+    }
+
+    // tiles x0 to x1, y0 to y1 of the band that bounds lo to hi touch, false
+    // and none if the triangle is culled
+    template<typename T>
+    bool
+    bin(T area, vec<2,T> const& lo, vec<2,T> const& hi, ::std::uint32_t range[4]) const {
+      if (!(area > T(0.0)) ||
+          hi.x <= T(0.0) || hi.y <= T(band[0]) ||
+          lo.x >= T(width) || lo.y >= T(band[1])) {
+        range[0] = range[1] = range[2] = range[3] = 0;
+        return false;
+      }
+
+      range[0] = size_t(max(lo.x, T(0.0))) / TILE;
+      range[1] = size_t(max(lo.y, T(band[0]))) / TILE;
+      range[2] = min(size_t(min(hi.x, T(width))) / TILE + 1, tiles_x);
+      range[3] = min(size_t(min(hi.y, T(band[1]))) / TILE + 1, (band[1] + TILE - 1) / TILE);
+      return true;
+    }
+
+    bool
+    kept_at(size_t x, size_t y) const {
+      return kept && kept[(y / TILE)*tiles_x + x / TILE];
+    }
+
+    template<typename T>
+    bool
+    all_kept(vec<2,T> const& lo, vec<2,T> const& hi) const {
+      ::std::uint32_t range[4];
+      bin(T(1.0), lo, hi, range);
+
+      for(size_t ty=range[1]; ty<range[3]; ty++)
+        for(size_t tx=range[0]; tx<range[2]; tx++)
+          if (!kept[ty*tiles_x + tx])
+            return false;
+      return true;
+    }
+
+    // Triangle lists are resolved a tile at a time into a buffer of depth and
+    // triangle number before shading, so each pixel is shaded once per draw. The
+    // nearest triangle wins even without a depth buffer.
+    void
+    set_deferred(bool enable) {
+      deferred = enable;
+    }
+
+    // Only rows y0 to y1 are rasterized. Bounds on a multiple of TILE give the
+    // same pixels as drawing the whole frame.
+    void
+    set_band(size_t y0, size_t y1) {
+      band[0] = y0;
+      band[1] = y1;
+    }
+
+    // Bounded draws are also skipped when hidden in this pyramid. One from an
+    // earlier frame can wrongly hide what has since come into view; draws that
+    // returned false can be drawn again once it is rebuilt from this frame.
+    void
+    set_occlusion(HiZ const *hiz) {
+      occlusion = hiz;
+    }
 
-    Context(size_t width, size_t height, unsigned char (*buffer)[4])
-      : width(width), height(height), buffer(buffer) {
+    // Counts into buffer, cleared here, or into counters of the context's own.
+    // The heatmap is off if they cannot be allocated.
+    void
+    set_heatmap(Heatmap mode, HeatBuffer *buffer = nullptr) {
+      if (!heat_buffer)
+        ::std::free(heat);
+      heat = nullptr;
+      heat_buffer = nullptr;
+      heatmap = heatmap_off;
+
+      if (mode == heatmap_off)
+        return;
+
+      if (buffer) {
+        if (!buffer->resize(width*height))
+          return;
+        heat_buffer = buffer;
+        heat = buffer->counts;
+        ::std::memset(heat, 0, sizeof(unsigned)*width*height);
+      } else if (!(heat = (unsigned *)::std::calloc(width*height, sizeof(unsigned)))) {
+        return;
+      }
+      heatmap = mode;
+    }
+
+    void
+    resolve_heatmap() {
+      if (!heat)
+        return;
+
+      unsigned peak = 1;
+      for(size_t i=0; i<width*height; i++)
+        peak = max(peak, heat[i]);
+
+      for(size_t y=0; y<height; y++)
+        for(size_t x=0; x<width; x+=4) {
+          size_t n = min(width - x, size_t(4));
+          vec<4,float> color[4];
+
+          for(size_t i=0; i<n; i++) {
+            unsigned h = heat[y*width+x+i];
+            float t = float(h) / float(peak);
+            color[i] = {
+              clamp(2.0f * t - 1.0f, 0.0f, 1.0f),
+              clamp(1.0f - ::std::abs(2.0f * t - 1.0f), 0.0f, 1.0f),
+              (h == 0) ? 0.0f : clamp(1.0f - 2.0f * t, 0.0f, 1.0f),
+              1.0f
+            };
+          }
+
+          write(x, y, color, (1u << n) - 1);
+        }
+    }
+
+    // rows are stored top down, y counts up from the bottom
+    Pixel *
+    row(size_t y) const {
+      return buffer + (height-1-y)*width;
+    }
+
+    Pixel *
+    tile_row(size_t x, size_t y) {
+      size_t t = (y / TILE)*tiles_x + x / TILE;
+      Pixel *p = tiles + t*TILE*TILE;
+
+      if (!dirty[t]) {
+        ::std::memset(p, 0, sizeof(Pixel)*TILE*TILE);
+        dirty[t] = 1;
+      }
+      return p + (y % TILE)*TILE + x % TILE;
+    }
+
+    // pixels x to x+3 of row y, as selected by mask
+    void
+    write(size_t x, size_t y, vec<4,float> const color[4], unsigned mask) {
+      if (!tiles) {
+        Format::store(row(y) + x, color, mask);
+        return;
+      }
+
+      size_t n = TILE - x % TILE;
+      if (n >= 4 || !(mask >> n)) {
+        Format::store(tile_row(x, y), color, mask);
+        return;
+      }
+
+      vec<4,float> rest[4];
+      for(size_t i=n; i<4; i++)
+        rest[i-n] = color[i];
+
+      if (unsigned m = mask & ((1u << n) - 1))
+        Format::store(tile_row(x, y), color, m);
+      Format::store(tile_row(x + n, y), rest, mask >> n);
+    }
+
+    void
+    reset_statistics() {
+      GL_STAT(draw_statistics = {});
+      GL_STAT(frame_statistics = {});
     }
 
     template<typename Prog>
     void
     draw(Prog& prog, void (*primitive)(Context&, Prog&, ID const&)) {
-      draw(prog, ID(), primitive);
+      draw(prog, ID{prog.vertices}, primitive);
     }
 
-    template<typename Prog, typename Index>
+    // draws only if the bounds, transformed by the object to clip matrix, may be in the view volume
+    template<typename Prog, typename Bounds>
+    bool
+    draw(Prog& prog, void (*primitive)(Context&, Prog&, ID const&), mat<4,typename Prog::Float> const& transform, Bounds const& bounds) {
+      return draw(prog, ID{prog.vertices}, primitive, transform, bounds);
+    }
+
+    template<typename Prog, typename Index, typename Bounds>
+    bool
+    draw(Prog& prog, Index const& index, void (*primitive)(Context&, Prog&, Index const&), mat<4,typename Prog::Float> const& transform, Bounds const& bounds) {
+      if (!visible(transform, bounds)) {
+        GL_STAT(draw_statistics = {});
+        GL_STAT(draw_statistics.draws_submitted = 1);
+        GL_STAT(draw_statistics.draws_culled = 1);
+        GL_STAT(frame_statistics += draw_statistics);
+        return false;
+      }
+
+      if (occlusion && occlusion->occluded(transform, bounds)) {
+        GL_STAT(draw_statistics = {});
+        GL_STAT(draw_statistics.draws_submitted = 1);
+        GL_STAT(draw_statistics.draws_occluded = 1);
+        GL_STAT(frame_statistics += draw_statistics);
+        return false;
+      }
+
+      draw(prog, index, primitive);
+      return true;
+    }
+
+    template<typename Prog>
     void
-    draw(Prog& prog, Index const& index, void (*primitive)(Context&, Prog&, Index const&)) {
+    shade(Prog& prog, size_t source, size_t target) {
       using T = typename Prog::Float;
+      using R = typename Prog::Raster;
       using Vertex = typename Prog::Vertex;
 
-      for(size_t i=0; i<prog.vertices; i++) {
-        char buf[sizeof(Vertex)] = {0};
-        auto v = (Vertex *)buf;
+      alignas(Vertex) char buf[sizeof(Vertex)] = {0};
+      auto v = (Vertex *)buf;
+
+      vec<4,T> position;
+
+      v->_ptr_gl_Position = &position;
+      prog.uniform.bind(v);
+      prog.attribute.bind(v, source);
+      auto out = prog.output(v, target);
+      v->main();
+      prog.capture(v, source);
+
+      vec<4,R> p = position;
+      p = {vec<3,R>(p) / p.w, R(1.0) / p.w};
+
+      Prog::fix_varying(v, T(p.w));
+      out.store();
+
+      prog.gl_Position[target] = {(vec<3,R> {p + R(1.0)} * R(0.5) * vec<3,R> {R(width), R(height), 1.0}), p.w};
+    }
+
+    // shades source[l] into target[l] for l < n, at most LANES vertices, in one
+    // run of the program's vertex shader
+    template<typename Prog, typename Group>
+    void
+    shade(Prog& prog, Group& group [[ gnu::unused ]], size_t const *source, size_t const *target, size_t n) {
+      if constexpr (Prog::LANES == 1) {
+        for(size_t l=0; l<n; l++)
+          shade(prog, source[l], target[l]);
+      } else {
+        using L = sl::float8;
+
+        group.run(source, n);
 
-        vec<4,T> p;
+        vec<4,L> p = group.position;
+        p = {vec<3,L>(p) / p.w, L(1.0f) / p.w};
 
-        v->_ptr_gl_Position = &p;
-        prog.uniform.bind(v);
-        prog.attribute.bind(v, i);
-        prog.varying.bind(v, i);
-        v->main();
+        group.scatter(source, target, n, p.w);
 
-        p = {vec<3,T>(p) / p.w, T(1.0) / p.w};
+        vec<3,L> q = vec<3,L> {p + L(1.0f)} * L(0.5f) * vec<3,L> {L(float(width)), L(float(height)), L(1.0f)};
+        shader::scatter<vec<4,float>>(prog.gl_Position, vec<4,L> {q, p.w}, target, n);
+      }
+    }
 
-        Prog::fix_varying(v, p.w);
+    template<typename Prog>
+    void
+    shade_vertices(Prog& prog) {
+      auto group = prog.group();
+      size_t index[Prog::LANES];
 
-        prog.gl_Position[i] = {(vec<3,T> {p + T(1.0)} * T(0.5) * vec<3,T> {T(width), T(height), 1.0}), p.w};
+      for(size_t i=0; i<prog.vertices; i+=Prog::LANES) {
+        size_t n = min(Prog::LANES, prog.vertices - i);
+        for(size_t l=0; l<n; l++)
+          index[l] = i + l;
+        shade(prog, group, index, index, n);
       }
+    }
+
+    template<typename Prog, typename Index>
+    void
+    draw(Prog& prog, Index const& index, void (*primitive)(Context&, Prog&, Index const&)) {
+      trace::Scope draw_scope("draw");
+      GL_STAT(draw_statistics = {});
+      GL_STAT(draw_statistics.draws_submitted = 1);
+      GL_STAT(auto t0 = stats::cycles());
+      TRACE_BEGIN(vertex_begin);
 
+      shade_vertices(prog);
+
+      TRACE_END(vertex_begin, "vertex");
+      GL_STAT(draw_statistics.vertex_shader_invocations += prog.vertices);
+      GL_STAT(auto t1 = stats::cycles());
+      GL_STAT(draw_statistics.vertex_cycles += t1 - t0);
+
+      TRACE_BEGIN(raster_begin);
       primitive(*this, prog, index);
+      TRACE_END(raster_begin, "rasterize");
+
+      GL_STAT(draw_statistics.raster_cycles += stats::cycles() - t1 - draw_statistics.fragment_cycles);
+      GL_STAT(frame_statistics += draw_statistics);
+    }
+
+    // Runs only the vertex stage, for the program's transform feedback. Nothing
+    // is rasterized.
+    template<typename Prog>
+    void
+    feedback(Prog& prog) {
+      trace::Scope draw_scope("feedback");
+      GL_STAT(draw_statistics = {});
+      GL_STAT(draw_statistics.draws_submitted = 1);
+      GL_STAT(auto t0 = stats::cycles());
+
+      shade_vertices(prog);
+
+      GL_STAT(draw_statistics.vertex_shader_invocations += prog.vertices);
+      GL_STAT(draw_statistics.vertex_cycles += stats::cycles() - t0);
+      GL_STAT(frame_statistics += draw_statistics);
+    }
+
+    // Streams the index buffer through a ring of two batches, each using half of the
+    // program's vertex storage. Batch k+1 is shaded on a second thread, started once
+    // per stream, while batch k is rasterized. Vertices repeated within a batch are
+    // shaded once, through a direct mapped cache.
+    template<typename Prog, typename Index>
+    void
+    stream(Prog& prog, Index const& index, void (*primitive)(Context&, Prog&, Batch const&)) {
+      trace::Scope draw_scope("stream");
+      GL_STAT(draw_statistics = {});
+      GL_STAT(draw_statistics.draws_submitted = 1);
+      GL_STAT(auto t0 = stats::cycles());
+
+      size_t n = index.size();
+      size_t batch = prog.vertices / 6 * 3;
+      size_t lines = 1;
+      while(lines < batch)
+        lines *= 2;
+
+      if (batch == 0)
+        return;
+
+      auto local = (::std::uint32_t *)::std::malloc(sizeof(::std::uint32_t) * batch * 2);
+      auto tag = (size_t *)::std::malloc(sizeof(size_t) * lines);
+      auto line = (::std::uint32_t *)::std::malloc(sizeof(::std::uint32_t) * lines);
+
+      auto shade_batch = [&](size_t k) {
+        trace::Scope vertex_scope("vertex");
+        size_t first = k * batch;
+        size_t count = min(batch, n - first);
+        size_t base = (k % 2) * batch;
+        size_t used = 0;
+
+        auto group = prog.group();
+        size_t source[Prog::LANES], target[Prog::LANES], pending = 0;
+
+        ::std::memset(tag, 0, sizeof(size_t) * lines);
+        for(size_t j=0; j<count; j++) {
+          size_t s = index[first + j];
+          size_t h = s & (lines - 1);
+
+          if (tag[h] != s + 1) {
+            tag[h] = s + 1;
+            line[h] = used;
+            source[pending] = s;
+            target[pending++] = base + used++;
+            if (pending == Prog::LANES) {
+              shade(prog, group, source, target, pending);
+              pending = 0;
+            }
+          }
+          local[base + j] = line[h];
+        }
+        if (pending)
+          shade(prog, group, source, target, pending);
+        return used;
+      };
+
+      size_t batches = (n + batch - 1) / batch;
+      size_t shaded [[ gnu::unused ]] = batches ? shade_batch(0) : 0;
+
+      // batches handed to the shading thread, and shaded by it
+      ::std::mutex mutex;
+      ::std::condition_variable changed;
+      size_t queued = 1, finished = 1;
+
+      ::std::thread shader;
+      if (batches > 1)
+        shader = ::std::thread([&] {
+          ::std::unique_lock<::std::mutex> lock(mutex);
+          while(finished < batches) {
+            changed.wait(lock, [&] { return queued > finished; });
+            size_t k = finished;
+            lock.unlock();
+            size_t used = shade_batch(k);
+            lock.lock();
+            shaded += used;
+            ++finished;
+            changed.notify_all();
+          }
+        });
+
+      for(size_t k=0; k<batches; k++) {
+        if (k + 1 < batches) {
+          ::std::lock_guard<::std::mutex> lock(mutex);
+          queued = k + 2;
+          changed.notify_all();
+        }
+
+        TRACE_BEGIN(raster_begin);
+        primitive(*this, prog, Batch{local + (k % 2) * batch, (k % 2) * batch, min(batch, n - k * batch)});
+        TRACE_END(raster_begin, "rasterize");
+
+        if (k + 1 < batches) {
+          ::std::unique_lock<::std::mutex> lock(mutex);
+          changed.wait(lock, [&] { return finished == k + 2; });
+        }
+      }
+
+      if (shader.joinable())
+        shader.join();
+
+      ::std::free(local);
+      ::std::free(tag);
+      ::std::free(line);
+
+      GL_STAT(draw_statistics.vertex_shader_invocations += shaded);
+      GL_STAT(draw_statistics.raster_cycles += stats::cycles() - t0 - draw_statistics.fragment_cycles);
+      GL_STAT(frame_statistics += draw_statistics);
     }
   };
 
-  template<typename Prog>
+  template<typename Format>
   void
-  draw_triangle(Context& context, Prog& prog, ::std::size_t i0, ::std::size_t i1, ::std::size_t i2) {
-      using T = typename Prog::Float;
-      using Fragment = typename Prog::Fragment;
+  HiZ::build(Context<Format> const& context) {
+    if (width != context.width || height != context.height) {
+      for(size_t k=0; k<levels; k++)
+        ::std::free(level[k]);
+
+      width = context.width;
+      height = context.height;
+      levels = 0;
+
+      for(size_t x=width, y=height; levels < LEVELS && (levels == 0 || x > 1 || y > 1); levels++) {
+        x = (x + 1) / 2;
+        y = (y + 1) / 2;
+        w[levels] = x;
+        h[levels] = y;
+        level[levels] = (float *)::std::malloc(sizeof(float)*x*y);
+      }
+    }
+
+    for(size_t k=0; k<levels; k++) {
+      size_t sw = k ? w[k-1] : width;
+      size_t sh = k ? h[k-1] : height;
+
+      for(size_t y=0; y<h[k]; y++)
+        for(size_t x=0; x<w[k]; x++) {
+          size_t x1 = min(2*x+1, sw-1), y1 = min(2*y+1, sh-1);
+          float d = 1.0f;
+
+          if (k > 0)
+            d = max(max(level[k-1][2*y*sw+2*x], level[k-1][2*y*sw+x1]), max(level[k-1][y1*sw+2*x], level[k-1][y1*sw+x1]));
+          else if (context.depth)
+            d = max(max(context.depth[2*y*sw+2*x], context.depth[2*y*sw+x1]), max(context.depth[y1*sw+2*x], context.depth[y1*sw+x1]));
+
+          level[k][y*w[k]+x] = d;
+        }
+    }
+  }
+
+  // Bilinear resize of src, sw x sh pixels, into rows r0 to r1 of dst, w x h
+  // pixels, both stored top row first. Pixel centers are aligned and edges
+  // clamp. Each source row is filtered horizontally once.
+  template<typename Format>
+  void
+  upscale(typename Format::Pixel const *src, size_t sw, size_t sh, typename Format::Pixel *dst, size_t w, size_t h, size_t r0, size_t r1) {
+    auto column = (size_t *)::std::malloc(sizeof(size_t) * w);
+    auto weight = (float *)::std::malloc(sizeof(float) * w);
+    auto line = (vec<4,float> *)::std::malloc(sizeof(vec<4,float>) * 2 * w);
+    size_t filtered[2] = {sh, sh};
+
+    for(size_t x=0; x<w; x++) {
+      float u = clamp((float(x) + 0.5f) * float(sw) / float(w) - 0.5f, 0.0f, float(sw - 1));
+      column[x] = size_t(u);
+      weight[x] = u - float(column[x]);
+    }
+
+    // two filtered rows, by parity of the source row
+    auto filter = [&](size_t y) {
+      vec<4,float> *l = line + (y % 2) * w;
+      if (filtered[y % 2] == y)
+        return l;
+      filtered[y % 2] = y;
+
+      for(size_t x=0; x<w; x++) {
+        vec<4,float> a = Format::load(src[y*sw + column[x]]);
+        vec<4,float> b = Format::load(src[y*sw + min(column[x] + 1, sw - 1)]);
+        l[x] = a + (b - a) * weight[x];
+      }
+      return l;
+    };
+
+    for(size_t r=r0; r<r1; r++) {
+      float v = clamp((float(r) + 0.5f) * float(sh) / float(h) - 0.5f, 0.0f, float(sh - 1));
+      size_t y = size_t(v);
+      float f = v - float(y);
+      vec<4,float> *a = filter(y);
+      vec<4,float> *b = filter(min(y + 1, sh - 1));
+
+      for(size_t x=0; x<w; x+=4) {
+        size_t n = min(w - x, size_t(4));
+        vec<4,float> color[4];
+        for(size_t i=0; i<n; i++)
+          color[i] = a[x+i] + (b[x+i] - a[x+i]) * f;
+        Format::store(dst + r*w + x, color, (1u << n) - 1);
+      }
+    }
+
+    ::std::free(column);
+    ::std::free(weight);
+    ::std::free(line);
+  }
+
+  // Runs the fragment shader for pixel (x, y) of the triangle with vertices i and
+  // window coordinates v, at barycentrics P divided by area and by w. Programs
+  // with DERIVATIVES run the float8 instance in quad instead, with the pixel's
+  // horizontal and vertical neighbours in the 2x2 quad as the other lanes.
+  template<typename Prog, typename Quad, typename T>
+  vec<4,float>
+  shade_pixel(Prog& prog, Quad& quad [[ gnu::unused ]], ::std::size_t const i[3], vec<4,T> const v[3], T area, ::std::size_t x, ::std::size_t y, vec<3,T> const& P) {
+    using Fragment = typename Prog::Fragment;
+
+    if constexpr (Prog::DERIVATIVES) {
+      vec<2,T> n[2] = {{T((x^1)+0.5), T(y+0.5)}, {T(x+0.5), T((y^1)+0.5)}};
+      vec<3,T> B[sl::QUAD_LANES] = {P};
+
+      for(::std::size_t l=0; l<2; l++) {
+        vec<3,T> Q = vec<3,T> {area2<T>(v[1], v[2], n[l]), area2<T>(v[2], v[0], n[l]), area2<T>(v[0], v[1], n[l])} / area;
+        B[l+1] = Q / interpolate(Q, v[0].w, v[1].w, v[2].w);
+      }
+      return quad.run(B, i);
+    } else {
+      alignas(Fragment) char buf[sizeof(Fragment)] = {0};
+      auto f = (Fragment *)buf;
+      vec<4,typename Prog::Float> fragment;
+
+      f->_ptr_gl_FragColor = &fragment;
+      prog.uniform.bind(f);
+
+      auto interpolation = prog.interpolate(P, i[0], i[1], i[2]);
+      interpolation.bind(f);
+      f->main();
+      return vec<4,float>(fragment);
+    }
+  }
+
+  template<typename Prog, typename Quad, typename Format>
+  void
+  draw_triangle(Context<Format>& context, Prog& prog, Quad& quad, ::std::size_t i0, ::std::size_t i1, ::std::size_t i2) {
+      using T = typename Prog::Raster;
 
       ::std::size_t width = context.width;
-      ::std::size_t height = context.height;
+      unsigned *heat = context.heat;
+      float *depth = context.depth;
+      Heatmap heatmap = context.heatmap;
+
+      ::std::size_t top = context.band[1];
 
       auto v0 = prog.gl_Position[i0];
       auto v1 = prog.gl_Position[i1];
       auto v2 = prog.gl_Position[i2];
 
+      GL_STAT(Statistics s = {});
+      GL_STAT(s.triangles_submitted = 1);
+
       auto area = area2<T>(v0, v1, v2);
 
-      for(size_t by=0; by<height; by+=4)
-        for(size_t bx=0; bx<width; bx+=4) {
+      vec<2,T> lo = min(min(vec<2,T>(v0), vec<2,T>(v1)), vec<2,T>(v2));
+      vec<2,T> hi = max(max(vec<2,T>(v0), vec<2,T>(v1)), vec<2,T>(v2));
+
+      if (!(area > T(0.0)) ||
+          hi.x <= T(0.0) || hi.y <= T(context.band[0]) ||
+          lo.x >= T(width) || lo.y >= T(top)) {
+        GL_STAT(s.triangles_culled = 1);
+        GL_STAT(context.draw_statistics += s);
+        return;
+      }
+
+      GL_STAT(s.triangles_crossing_edge = (lo.x < T(0.0) || lo.y < T(0.0) || hi.x > T(width) || hi.y > T(context.height)));
+
+      if (context.kept && context.all_kept(lo, hi)) {
+        GL_STAT(context.draw_statistics += s);
+        return;
+      }
+
+      ::std::size_t i[3] = {i0, i1, i2};
+      vec<4,T> v[3] = {v0, v1, v2};
+
+      // shades one covered pixel into color, false if it failed the depth test
+      auto shade_fragment = [&](size_t x, size_t y, vec<3,T> P, vec<4,float>& color) {
+        P = P / area;
+        vec<4,T> gl_FragCoord = {
+            vec<2,T> {T(x+0.5), T(y+0.5)},
+            interpolate(P, v0.z, v1.z, v2.z),
+            interpolate(P, v0.w, v1.w, v2.w)
+        };
+
+        if (depth) {
+          if (!(gl_FragCoord.z < T(depth[y*width+x])))
+            return false;
+          depth[y*width+x] = gl_FragCoord.z;
+        }
+
+        color = shade_pixel(prog, quad, i, v, area, x, y, vec<3,T>(P / gl_FragCoord.w));
+        GL_STAT(++s.fragments_shaded);
+        if (heatmap == heatmap_shaded)
+          ++heat[y*width+x];
+
+        GL_STAT(++s.fragments_written);
+        if (heatmap == heatmap_overdraw)
+          ++heat[y*width+x];
+        return true;
+      };
+
+      // shaded colors of a 4x4 block, converted to the framebuffer format a row at a time
+      vec<4,float> color[4][4];
+      auto store_block = [&](size_t bx, size_t by, unsigned written) {
+        for(size_t r=0; r<4; r++)
+          if (unsigned m = (written >> (4*r)) & 0xf)
+            context.write(bx, by+r, color[r], m);
+      };
+
+      // micro triangles: every pixel center they can cover lies in the 4x4 window at
+      // the floor of lo, so skip the block walk and test those 16 centers at once
+      if (lo.x >= T(0.0) && lo.y >= T(context.band[0]) && hi.x < T(width) && hi.y < T(top) &&
+          size_t(hi.x) - size_t(lo.x) < 4 && size_t(hi.y) - size_t(lo.y) < 4) {
+        size_t bx = size_t(lo.x);
+        size_t by = size_t(lo.y);
+        size_t bx2 = min(bx+4, width);
+        size_t by2 = min(by+4, top);
+
+        vec<4,T> e[3][4];
+        edge<T>(v1, v2, bx, by, e[0]);
+        edge<T>(v2, v0, bx, by, e[1]);
+        edge<T>(v0, v1, bx, by, e[2]);
+        unsigned mask = coverage<T>(e);
+
+        GL_STAT(++s.blocks_tested);
+        GL_STAT(s.blocks_rejected += (mask == 0));
+        GL_STAT(s.fragments_tested += (bx2-bx) * (by2-by));
+        GL_STAT(auto t0 = stats::cycles());
+
+        if (heatmap == heatmap_tests)
+          for(size_t y=by; y<by2; ++y)
+            for(size_t x=bx; x<bx2; ++x)
+              heat[y*width+x] += 2;
+
+        unsigned written = 0;
+        for(unsigned m=mask; m; m &= m - 1) {
+          unsigned k = __builtin_ctz(m);
+          size_t r = k / 4, c = k % 4;
+          if (!context.kept_at(bx+c, by+r) &&
+              shade_fragment(bx+c, by+r, vec<3,T> {e[0][r][c], e[1][r][c], e[2][r][c]}, color[r][c]))
+            written |= 1u << k;
+        }
+        store_block(bx, by, written);
+
+        GL_STAT(s.fragment_cycles += stats::cycles() - t0);
+        GL_STAT(context.draw_statistics += s);
+        return;
+      }
+
+      size_t bx0 = size_t(max(lo.x, T(0.0))) & ~size_t(3);
+      size_t by0 = size_t(max(lo.y, T(context.band[0]))) & ~size_t(3);
+
+      for(size_t by=by0; by<top && T(by) < hi.y; by+=4)
+        for(size_t bx=bx0; bx<width && T(bx) < hi.x; bx+=4) {
+          if (context.kept_at(bx, by))
+            continue;
+
           size_t bx2 = min(bx+4, width);
-          size_t by2 = min(by+4, height);
+          size_t by2 = min(by+4, top);
 
           vec<2,T> box[4] = {
             {T(bx), T(by)},  {T(bx2), T(by)},
             {T(bx), T(by2)}, {T(bx2), T(by2)}
           };
 
-          if (outside<T>(v1, v2, box) ||
-              outside<T>(v2, v0, box) ||
-              outside<T>(v0, v1, box))
+          GL_STAT(++s.blocks_tested);
+
+          bool rejected =
+            outside<T>(v1, v2, box) ||
+            outside<T>(v2, v0, box) ||
+            outside<T>(v0, v1, box);
+
+          if (heatmap == heatmap_tests)
+            for(size_t y=by; y<by2; ++y)
+              for(size_t x=bx; x<bx2; ++x)
+                ++heat[y*width+x];
+
+          if (rejected) {
+            GL_STAT(++s.blocks_rejected);
             continue;
+          }
+
+          GL_STAT(s.blocks_accepted += inside<T>(v1, v2, box) && inside<T>(v2, v0, box) && inside<T>(v0, v1, box));
+          GL_STAT(auto t0 = stats::cycles());
+          unsigned written = 0;
 
           for(size_t y=by; y<by2; ++y)
             for(size_t x=bx; x<bx2; ++x) {
               vec<2,T> p = {T(x+0.5), T(y+0.5)};
               vec<3,T> P = {area2<T>(v1, v2, p), area2<T>(v2, v0, p), area2<T>(v0, v1, p)};
 
+              GL_STAT(++s.fragments_tested);
+              if (heatmap == heatmap_tests)
+                ++heat[y*width+x];
+
               if (!all(greaterThan(P, {0.0})))
                 continue;
 
-              P = P / area;
-              vec<4,T> gl_FragCoord = {
-                  p,
-                  interpolate(P, v0.z, v1.z, v2.z),
-                  interpolate(P, v0.w, v1.w, v2.w)
-              };
+              if (shade_fragment(x, y, P, color[y-by][x-bx]))
+                written |= 1u << (4*(y-by) + (x-bx));
+            }
+
+          store_block(bx, by, written);
+
+          GL_STAT(s.fragment_cycles += stats::cycles() - t0);
+        }
+
+      GL_STAT(context.draw_statistics += s);
+  }
+
+  template<typename Prog, typename Quad, typename Index, typename Format>
+  void
+  deferred_triangles(Context<Format>& context, Prog& prog, Quad& quad, Index const& index) {
+    using T = typename Prog::Raster;
+
+    constexpr ::std::size_t TILE = Context<Format>::TILE;
+    constexpr ::std::uint32_t NONE = ~::std::uint32_t(0);
+
+    ::std::size_t width = context.width;
+    ::std::size_t height = context.height;
+    ::std::size_t tiles_x = (width + TILE - 1) / TILE;
+    ::std::size_t tiles_y = (height + TILE - 1) / TILE;
+    ::std::size_t n = index.size() / 3;
+    unsigned *heat = context.heat;
+    float *depth = context.depth;
+    Heatmap heatmap = context.heatmap;
+
+    GL_STAT(Statistics s = {});
+    GL_STAT(s.triangles_submitted = n);
+
+    auto window = [&](::std::size_t k, vec<4,T> v[3]) {
+      for(::std::size_t j=0; j<3; j++)
+        v[j] = prog.gl_Position[index[3*k+j]];
+      return area2<T>(v[0], v[1], v[2]);
+    };
+
+    // tiles touched by each triangle's bounds, empty when culled, binned by a
+    // counting sort so that bin[first[t]] to bin[first[t+1]] are tile t's in order
+    auto range = (::std::uint32_t (*)[4])::std::malloc(sizeof(*range) * n);
+    auto first = (::std::size_t *)::std::calloc(tiles_x*tiles_y + 1, sizeof(::std::size_t));
+
+    for(::std::size_t k=0; k<n; k++) {
+      vec<4,T> v[3];
+      T area = window(k, v);
+
+      vec<2,T> lo = min(min(vec<2,T>(v[0]), vec<2,T>(v[1])), vec<2,T>(v[2]));
+      vec<2,T> hi = max(max(vec<2,T>(v[0]), vec<2,T>(v[1])), vec<2,T>(v[2]));
+
+      if (!context.bin(area, lo, hi, range[k])) {
+        GL_STAT(++s.triangles_culled);
+        continue;
+      }
+
+      GL_STAT(s.triangles_crossing_edge += (lo.x < T(0.0) || lo.y < T(0.0) || hi.x > T(width) || hi.y > T(height)));
+
+      for(::std::size_t ty=range[k][1]; ty<range[k][3]; ty++)
+        for(::std::size_t tx=range[k][0]; tx<range[k][2]; tx++)
+          ++first[ty*tiles_x + tx + 1];
+    }
+
+    for(::std::size_t t=0; t<tiles_x*tiles_y; t++)
+      first[t+1] += first[t];
+
+    auto bin = (::std::uint32_t *)::std::malloc(sizeof(::std::uint32_t) * first[tiles_x*tiles_y]);
+    auto next = (::std::size_t *)::std::malloc(sizeof(::std::size_t) * tiles_x*tiles_y);
+    ::std::memcpy(next, first, sizeof(::std::size_t) * tiles_x*tiles_y);
+
+    for(::std::size_t k=0; k<n; k++)
+      for(::std::size_t ty=range[k][1]; ty<range[k][3]; ty++)
+        for(::std::size_t tx=range[k][0]; tx<range[k][2]; tx++)
+          bin[next[ty*tiles_x + tx]++] = k;
+
+    float visible_depth[TILE*TILE];
+    ::std::uint32_t visible[TILE*TILE];
+    vec<4,float> color[4][4];
+
+    for(::std::size_t t=0; t<tiles_x*tiles_y; t++) {
+      if (first[t] == first[t+1] || (context.kept && context.kept[t]))
+        continue;
 
-              P = P / gl_FragCoord.w;
+      ::std::size_t x0 = (t % tiles_x) * TILE, y0 = (t / tiles_x) * TILE;
+      ::std::size_t x1 = min(x0 + TILE, width), y1 = min(y0 + TILE, context.band[1]);
 
-              char buf[sizeof(Fragment)] = {0};
-              auto f = (Fragment *)buf;
+      for(::std::size_t y=y0; y<y1; y++)
+        for(::std::size_t x=x0; x<x1; x++) {
+          visible_depth[(y-y0)*TILE + x-x0] = depth ? depth[y*width+x] : INFINITY;
+          visible[(y-y0)*TILE + x-x0] = NONE;
+        }
+
+      // visibility: the nearest covering triangle of each pixel, the first on ties
+      for(::std::size_t b=first[t]; b<first[t+1]; b++) {
+        ::std::uint32_t k = bin[b];
+        vec<4,T> v[3];
+        T area = window(k, v);
+
+        vec<2,T> lo = min(min(vec<2,T>(v[0]), vec<2,T>(v[1])), vec<2,T>(v[2]));
+        vec<2,T> hi = max(max(vec<2,T>(v[0]), vec<2,T>(v[1])), vec<2,T>(v[2]));
+
+        ::std::size_t bx0 = max(x0, size_t(max(lo.x, T(0.0))) & ~size_t(3));
+        ::std::size_t by0 = max(y0, size_t(max(lo.y, T(0.0))) & ~size_t(3));
+
+        for(::std::size_t by=by0; by<y1 && T(by) < hi.y; by+=4)
+          for(::std::size_t bx=bx0; bx<x1 && T(bx) < hi.x; bx+=4) {
+            ::std::size_t w = min(x1 - bx, size_t(4)), h = min(y1 - by, size_t(4));
+            unsigned valid = 0;
+            for(::std::size_t r=0; r<h; r++)
+              valid |= ((1u << w) - 1) << (4*r);
+
+            vec<4,T> e[3][4];
+            edge<T>(v[1], v[2], bx, by, e[0]);
+            edge<T>(v[2], v[0], bx, by, e[1]);
+            edge<T>(v[0], v[1], bx, by, e[2]);
+            unsigned mask = coverage<T>(e) & valid;
 
-              vec<4,T> color;
+            GL_STAT(++s.blocks_tested);
+            GL_STAT(s.blocks_rejected += (mask == 0));
+            GL_STAT(s.fragments_tested += w * h);
 
-              f->_ptr_gl_FragColor = &color;
-              prog.uniform.bind(f);
+            if (heatmap == heatmap_tests)
+              for(::std::size_t y=by; y<by+h; ++y)
+                for(::std::size_t x=bx; x<bx+w; ++x)
+                  ++heat[y*width+x];
 
-              auto i = prog.interpolate(P, i0, i1, i2);
-              i.bind(f);
-              f->main();
+            for(unsigned m=mask; m; m &= m - 1) {
+              unsigned q = __builtin_ctz(m);
+              ::std::size_t r = q / 4, c = q % 4;
+              ::std::size_t p = (by+r-y0)*TILE + bx+c-x0;
+              T z = interpolate(vec<3,T> {e[0][r][c], e[1][r][c], e[2][r][c]} / area, v[0].z, v[1].z, v[2].z);
 
-              unsigned char (&xrgb)[4] = context.buffer[(height-1-y)*width+x];
-              xrgb[0] = color.b * 255;
-              xrgb[1] = color.g * 255;
-              xrgb[2] = color.r * 255;
-              xrgb[3] = color.a * 255;
+              if (z < T(visible_depth[p])) {
+                visible_depth[p] = z;
+                visible[p] = k;
+              }
             }
+          }
+      }
+
+      // shading: once per pixel with a visible triangle
+      GL_STAT(auto t0 = stats::cycles());
+      for(::std::size_t by=y0; by<y1; by+=4)
+        for(::std::size_t bx=x0; bx<x1; bx+=4) {
+          unsigned written = 0;
+
+          for(::std::size_t y=by; y<min(by+4, y1); y++)
+            for(::std::size_t x=bx; x<min(bx+4, x1); x++) {
+              ::std::size_t p = (y-y0)*TILE + x-x0;
+              if (visible[p] == NONE || y < context.band[0])
+                continue;
+
+              ::std::uint32_t k = visible[p];
+              ::std::size_t i[3] = {index[3*k], index[3*k+1], index[3*k+2]};
+              vec<4,T> v[3];
+              T area = window(k, v);
+
+              vec<2,T> c = {T(x+0.5), T(y+0.5)};
+              vec<3,T> P = vec<3,T> {area2<T>(v[1], v[2], c), area2<T>(v[2], v[0], c), area2<T>(v[0], v[1], c)} / area;
+
+              if (depth)
+                depth[y*width+x] = visible_depth[p];
+
+              color[y-by][x-bx] = shade_pixel(prog, quad, i, v, area, x, y, vec<3,T>(P / interpolate(P, v[0].w, v[1].w, v[2].w)));
+              written |= 1u << (4*(y-by) + (x-bx));
+
+              GL_STAT(++s.fragments_shaded);
+              GL_STAT(++s.fragments_written);
+              if (heatmap == heatmap_shaded || heatmap == heatmap_overdraw)
+                ++heat[y*width+x];
+            }
+
+          for(::std::size_t r=0; r<4; r++)
+            if (unsigned m = (written >> (4*r)) & 0xf)
+              context.write(bx, by+r, color[r], m);
         }
+      GL_STAT(s.fragment_cycles += stats::cycles() - t0);
+    }
+
+    ::std::free(range);
+    ::std::free(first);
+    ::std::free(bin);
+    ::std::free(next);
+
+    GL_STAT(context.draw_statistics += s);
   }
 
-  template<typename Prog, typename Index>
+  // Signs the tiles the triangles touch, marks those the cache can keep, and
+  // clears the others before they are drawn
+  template<typename Prog, typename Index, typename Format>
   void
-  triangles(Context& context, Prog& prog, Index const& index) {
-    for(::std::size_t i=0; (i+2) < prog.vertices; i+=3) {
-      draw_triangle(context, prog, index[i], index[i+1], index[i+2]);
+  cache_tiles(Context<Format>& context, Prog& prog, Index const& index) {
+    using T = typename Prog::Raster;
+
+    constexpr ::std::size_t TILE = Context<Format>::TILE;
+
+    auto& cache = *context.cache;
+    ::std::size_t tiles = context.tiles_x * context.tiles_y;
+    ::std::uint64_t draw = prog.uniform.data.hash(0, typeid(Prog).hash_code());
+
+    GL_STAT(Statistics s = {});
+
+    auto sign = (::std::uint64_t *)::std::malloc(sizeof(::std::uint64_t) * tiles);
+    auto touched = (unsigned char *)::std::calloc(tiles, 1);
+
+    for(::std::size_t t=0; t<tiles; t++)
+      sign[t] = draw;
+
+    for(::std::size_t k=0; (3*k+2) < index.size(); k++) {
+      vec<4,T> v[3];
+      ::std::uint64_t h = draw;
+
+      for(::std::size_t j=0; j<3; j++) {
+        v[j] = prog.gl_Position[index[3*k+j]];
+        h = hash_bytes(h, &v[j], sizeof(v[j]));
+        h = prog.varying.data.hash(index[3*k+j], h);
+      }
+
+      vec<2,T> lo = min(min(vec<2,T>(v[0]), vec<2,T>(v[1])), vec<2,T>(v[2]));
+      vec<2,T> hi = max(max(vec<2,T>(v[0]), vec<2,T>(v[1])), vec<2,T>(v[2]));
+      ::std::uint32_t range[4];
+
+      if (!context.bin(area2<T>(v[0], v[1], v[2]), lo, hi, range))
+        continue;
+
+      for(::std::size_t ty=range[1]; ty<range[3]; ty++)
+        for(::std::size_t tx=range[0]; tx<range[2]; tx++) {
+          ::std::size_t t = ty*context.tiles_x + tx;
+          sign[t] = hash_bytes(sign[t], &h, sizeof(h));
+          touched[t] = 1;
+        }
     }
+
+    for(::std::size_t t=0; t<tiles; t++) {
+      if (!touched[t])
+        continue;
+
+      GL_STAT(++s.tiles_signed);
+      if (cache.current_draws[t] == 0 && cache.last_draws[t] == 1 && cache.last[t] == sign[t]) {
+        GL_STAT(++s.tiles_kept);
+        context.kept[t] = 1;
+        context.dirty[t] = 1;
+      } else {
+        // binned tiles may not be written, but must not keep older pixels
+        context.tile_row((t % context.tiles_x) * TILE, (t / context.tiles_x) * TILE);
+      }
+
+      cache.current[t] = sign[t];
+      cache.current_draws[t] = min(cache.current_draws[t] + 1, 2);
+    }
+
+    ::std::free(sign);
+    ::std::free(touched);
+
+    GL_STAT(context.draw_statistics += s);
+  }
+
+  template<typename Prog, typename Index, typename Format>
+  void
+  triangles(Context<Format>& context, Prog& prog, Index const& index) {
+    bool cached = context.cache && !context.depth && !context.heat;
+    if (cached)
+      cache_tiles(context, prog, index);
+
+    auto quad = prog.quad();
+    if (context.deferred)
+      deferred_triangles(context, prog, quad, index);
+    else
+      for(::std::size_t i=0; (i+2) < index.size(); i+=3) {
+        draw_triangle(context, prog, quad, index[i], index[i+1], index[i+2]);
+      }
+
+    if (cached)
+      ::std::memset(context.kept, 0, context.tiles_x * context.tiles_y);
+  }
   }
 }
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mesh.h"
+
+static bool
+fits(const struct mesh *mesh, uint64_t offset, uint64_t count, uint64_t size) {
+  if (offset % 16 || offset > mesh->size)
+    return false;
+  return size == 0 || count <= (mesh->size - offset) / size;
+}
+
+static bool
+validate(const struct mesh *mesh) {
+  const struct mesh_header *h = mesh->header;
+
+  if (mesh->size < sizeof(*h) || memcmp(h->magic, MESH_MAGIC, sizeof(h->magic)) != 0 || h->version != MESH_VERSION)
+    return false;
+  if (h->attributes > (mesh->size - sizeof(*h)) / sizeof(struct mesh_attribute))
+    return false;
+  if (!fits(mesh, h->index_offset, h->indices, sizeof(uint32_t)))
+    return false;
+
+  for(uint32_t i=0; i<h->attributes; i++) {
+    const struct mesh_attribute *a = &mesh->attributes[i];
+    if (memchr(a->name, 0, sizeof(a->name)) == NULL || !fits(mesh, a->offset, h->vertices, a->stride))
+      return false;
+  }
+
+  /* indices past the attributes would be read out of bounds when drawn */
+  const uint32_t *index = (const uint32_t *)((const char *)mesh->base + h->index_offset);
+  uint32_t any = 0;
+  for(uint64_t i=0; i<h->indices; i++)
+    any |= index[i] >= h->vertices;
+
+  return !any;
+}
+
+bool
+mesh_open(struct mesh *mesh, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+
+  mesh->size = st.st_size;
+  mesh->base = mmap(NULL, mesh->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mesh->base == MAP_FAILED) {
+    perror(path);
+    return false;
+  }
+
+  mesh->header = mesh->base;
+  mesh->attributes = (const struct mesh_attribute *)(mesh->header + 1);
+
+  if (!validate(mesh)) {
+    fprintf(stderr, "%s: not a valid mesh\n", path);
+    mesh_close(mesh);
+    return false;
+  }
+
+  return true;
+}
+
+void
+mesh_close(struct mesh *mesh) {
+  munmap(mesh->base, mesh->size);
+  memset(mesh, 0, sizeof(*mesh));
+}
+
+const struct mesh_attribute *
+mesh_find(const struct mesh *mesh, const char *name) {
+  for(uint32_t i=0; i<mesh->header->attributes; i++)
+    if (strcmp(mesh->attributes[i].name, name) == 0)
+      return &mesh->attributes[i];
+  return NULL;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * On-disk layout, little endian:
+ *
+ *   mesh_header
+ *   mesh_attribute[header.attributes]
+ *   payloads, each starting on a MESH_ALIGN boundary
+ *
+ * Attribute payloads hold header.vertices elements of `stride` bytes,
+ * laid out like the in-memory vector type so they can be bound in
+ * place. The index payload holds header.indices uint32_t. lo and hi
+ * bound the positions. The header, descriptors and index values are
+ * checked at open, so pages of an attribute payload are not touched
+ * before it is drawn.
+ */
+
+#define MESH_MAGIC "TRIMESH"
+#define MESH_VERSION 2
+#define MESH_ALIGN 4096
+
+enum mesh_type {
+  MESH_FLOAT32 = 1
+};
+
+struct mesh_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t attributes;
+  uint64_t vertices;
+  uint64_t indices;
+  uint64_t index_offset;
+  float lo[3];
+  float hi[3];
+};
+
+struct mesh_attribute {
+  char name[48];
+  uint32_t type;
+  uint32_t components;
+  uint32_t stride;
+  uint32_t reserved;
+  uint64_t offset;
+};
+
+struct mesh {
+  void *base;
+  size_t size;
+  const struct mesh_header *header;
+  const struct mesh_attribute *attributes;
+};
+
+bool mesh_open(struct mesh *mesh, const char *path);
+void mesh_close(struct mesh *mesh);
+const struct mesh_attribute *mesh_find(const struct mesh *mesh, const char *name);
+
+#ifdef __cplusplus
+}
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
+namespace gl {
+  inline namespace GL_ISA {
+  namespace mesh {
+    struct Index {
+      const uint32_t *data;
+      size_t count;
+
+      size_t operator[](size_t n) const { return data[n]; }
+      size_t size() const { return count; }
+    };
+
+    template<typename V>
+    V *
+    attribute(struct ::mesh const& m, const char *name) {
+      static_assert(sizeof(typename V::SCALAR) == 4);
+      const struct mesh_attribute *a = mesh_find(&m, name);
+
+      if (!a || a->type != MESH_FLOAT32 || a->components != V::SIZE || a->stride != sizeof(V))
+        return nullptr;
+      return (V *)((char *)m.base + a->offset);
+    }
+
+    inline
+    Index
+    indices(struct ::mesh const& m) {
+      return {(const uint32_t *)((const char *)m.base + m.header->index_offset), m.header->indices};
+    }
+  }
+  }
+}
+#endif
@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "mesh.h"
+
+/* vec3 and vec4 are both stored as four floats, matching sl::vec<3,float> on SSE targets */
+#define POSITION 0
+#define NORMAL 1
+#define TEXCOORD 2
+#define COLOR 3
+#define ATTRIBUTES 4
+
+static const struct {
+  const char *name;
+  uint32_t components;
+  uint32_t stride;
+} attributes[ATTRIBUTES] = {
+  {"position", 3, 16},
+  {"normal",   3, 16},
+  {"texcoord", 2, 8},
+  {"color",    3, 16},
+};
+
+struct array {
+  void *data;
+  size_t size;
+  size_t capacity;
+};
+
+struct model {
+  bool present[ATTRIBUTES];
+  struct array vertex[ATTRIBUTES];
+  struct array index;
+  size_t vertices;
+};
+
+#define DIE(...)                                \
+  do {                                          \
+    fprintf(stderr, __VA_ARGS__);               \
+    fputc('\n', stderr);                        \
+    exit(EXIT_FAILURE);                         \
+  } while(0)
+
+static void *
+push(struct array *a, size_t size) {
+  if (a->size + size > a->capacity) {
+    a->capacity = a->capacity ? a->capacity * 2 : 4096;
+    if (a->capacity < a->size + size)
+      a->capacity = a->size + size;
+    a->data = realloc(a->data, a->capacity);
+    if (!a->data)
+      DIE("out of memory");
+  }
+  void *p = (char *)a->data + a->size;
+  a->size += size;
+  memset(p, 0, size);
+  return p;
+}
+
+static void
+push_index(struct model *m, uint32_t i) {
+  *(uint32_t *)push(&m->index, sizeof(uint32_t)) = i;
+}
+
+static uint32_t
+new_vertex(struct model *m) {
+  if (m->vertices >= UINT32_MAX)
+    DIE("too many vertices");
+  for(int a=0; a<ATTRIBUTES; a++)
+    push(&m->vertex[a], attributes[a].stride);
+  return m->vertices++;
+}
+
+static float *
+vertex(struct model *m, int a, uint32_t v) {
+  return (float *)((char *)m->vertex[a].data + (size_t)v * attributes[a].stride);
+}
+
+
+/* OBJ: v [rgb], vt, vn and polygonal f, triangulated as fans */
+
+struct key {
+  long v, t, n;
+  uint32_t index;
+};
+
+struct table {
+  struct key *keys;
+  size_t capacity;
+  size_t size;
+};
+
+static size_t
+hash(long v, long t, long n) {
+  uint64_t h = (uint64_t)v * 0x9e3779b97f4a7c15ull;
+  h ^= (uint64_t)t * 0xc2b2ae3d27d4eb4full + (h << 6) + (h >> 2);
+  h ^= (uint64_t)n * 0x165667b19e3779f9ull + (h << 6) + (h >> 2);
+  return h;
+}
+
+static struct key *
+lookup(struct table *t, long v, long tc, long n) {
+  if ((t->size + 1) * 2 > t->capacity) {
+    struct table u = {calloc(t->capacity ? t->capacity * 2 : 1024, sizeof(struct key)), t->capacity ? t->capacity * 2 : 1024, t->size};
+    if (!u.keys)
+      DIE("out of memory");
+    for(size_t i=0; i<t->capacity; i++)
+      if (t->keys[i].v) {
+        size_t j = hash(t->keys[i].v, t->keys[i].t, t->keys[i].n) & (u.capacity - 1);
+        while(u.keys[j].v)
+          j = (j + 1) & (u.capacity - 1);
+        u.keys[j] = t->keys[i];
+      }
+    free(t->keys);
+    *t = u;
+  }
+
+  size_t j = hash(v, tc, n) & (t->capacity - 1);
+  while(t->keys[j].v && !(t->keys[j].v == v && t->keys[j].t == tc && t->keys[j].n == n))
+    j = (j + 1) & (t->capacity - 1);
+  return &t->keys[j];
+}
+
+static long
+resolve(long i, size_t count, size_t line) {
+  if (i < 0)
+    i += (long)count + 1;
+  if (i <= 0 || (size_t)i > count)
+    DIE("line %zu: index out of range", line);
+  return i;
+}
+
+static void
+read_obj(FILE *f, struct model *m) {
+  struct array v = {0}, vt = {0}, vn = {0}, vc = {0};
+  struct table table = {0};
+  char line[4096];
+  size_t lineno = 0;
+
+  while(fgets(line, sizeof(line), f)) {
+    ++lineno;
+    char *p = line;
+    while(isspace((unsigned char)*p))
+      ++p;
+
+    if (strncmp(p, "v ", 2) == 0) {
+      float *x = push(&v, 3 * sizeof(float));
+      float *c = push(&vc, 3 * sizeof(float));
+      int n = sscanf(p + 2, "%f %f %f %f %f %f", &x[0], &x[1], &x[2], &c[0], &c[1], &c[2]);
+      if (n < 3)
+        DIE("line %zu: bad vertex", lineno);
+      if (n == 6)
+        m->present[COLOR] = true;
+      else
+        c[0] = c[1] = c[2] = 1.0f;
+    } else if (strncmp(p, "vt ", 3) == 0) {
+      float *x = push(&vt, 2 * sizeof(float));
+      if (sscanf(p + 3, "%f %f", &x[0], &x[1]) < 1)
+        DIE("line %zu: bad texture coordinate", lineno);
+    } else if (strncmp(p, "vn ", 3) == 0) {
+      float *x = push(&vn, 3 * sizeof(float));
+      if (sscanf(p + 3, "%f %f %f", &x[0], &x[1], &x[2]) < 3)
+        DIE("line %zu: bad normal", lineno);
+    } else if (strncmp(p, "f ", 2) == 0) {
+      uint32_t first = 0, prev = 0;
+      size_t corners = 0;
+      char *save, *tok;
+
+      for(tok = strtok_r(p + 2, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+        long iv = 0, it = 0, in = 0;
+        char *s = tok, *e;
+
+        iv = resolve(strtol(s, &e, 10), v.size / (3 * sizeof(float)), lineno);
+        if (*e == '/') {
+          s = e + 1;
+          if (*s != '/') {
+            it = resolve(strtol(s, &e, 10), vt.size / (2 * sizeof(float)), lineno);
+            m->present[TEXCOORD] = true;
+          } else {
+            e = s;
+          }
+          if (*e == '/') {
+            in = resolve(strtol(e + 1, &e, 10), vn.size / (3 * sizeof(float)), lineno);
+            m->present[NORMAL] = true;
+          }
+        }
+
+        struct key *k = lookup(&table, iv, it, in);
+        if (!k->v) {
+          *k = (struct key){iv, it, in, new_vertex(m)};
+          table.size++;
+          memcpy(vertex(m, POSITION, k->index), (float *)v.data + 3 * (iv - 1), 3 * sizeof(float));
+          memcpy(vertex(m, COLOR, k->index), (float *)vc.data + 3 * (iv - 1), 3 * sizeof(float));
+          if (it)
+            memcpy(vertex(m, TEXCOORD, k->index), (float *)vt.data + 2 * (it - 1), 2 * sizeof(float));
+          if (in)
+            memcpy(vertex(m, NORMAL, k->index), (float *)vn.data + 3 * (in - 1), 3 * sizeof(float));
+        }
+
+        if (corners == 0)
+          first = k->index;
+        else if (corners >= 2) {
+          push_index(m, first);
+          push_index(m, prev);
+          push_index(m, k->index);
+        }
+        prev = k->index;
+        ++corners;
+      }
+    }
+  }
+
+  m->present[POSITION] = true;
+  free(v.data);
+  free(vt.data);
+  free(vn.data);
+  free(vc.data);
+  free(table.keys);
+}
+
+
+/* PLY: ascii and binary, vertex x y z [nx ny nz] [s t | u v] [red green blue], face vertex_indices */
+
+enum ply_format { PLY_ASCII, PLY_LITTLE, PLY_BIG };
+
+struct property {
+  char name[64];
+  int type;
+  int count_type;
+};
+
+struct element {
+  char name[64];
+  size_t count;
+  size_t properties;
+  struct property property[32];
+};
+
+static int
+ply_type(const char *name) {
+  static const char *names[][2] = {
+    {"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+    {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}
+  };
+  for(int i=0; i<8; i++)
+    if (strcmp(name, names[i][0]) == 0 || strcmp(name, names[i][1]) == 0)
+      return i;
+  DIE("unknown ply type %s", name);
+}
+
+static const size_t ply_size[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+static double
+ply_read(FILE *f, enum ply_format format, int type) {
+  if (format == PLY_ASCII) {
+    double d;
+    if (fscanf(f, "%lf", &d) != 1)
+      DIE("truncated ply");
+    return d;
+  }
+
+  unsigned char b[8];
+  size_t n = ply_size[type];
+  if (fread(b, 1, n, f) != n)
+    DIE("truncated ply");
+
+  int little = 1;
+  if ((*(char *)&little == 1) != (format == PLY_LITTLE))
+    for(size_t i=0; i<n/2; i++) {
+      unsigned char t = b[i];
+      b[i] = b[n-1-i];
+      b[n-1-i] = t;
+    }
+
+  switch(type) {
+  case 0: { int8_t x; memcpy(&x, b, 1); return x; }
+  case 1: { uint8_t x; memcpy(&x, b, 1); return x; }
+  case 2: { int16_t x; memcpy(&x, b, 2); return x; }
+  case 3: { uint16_t x; memcpy(&x, b, 2); return x; }
+  case 4: { int32_t x; memcpy(&x, b, 4); return x; }
+  case 5: { uint32_t x; memcpy(&x, b, 4); return x; }
+  case 6: { float x; memcpy(&x, b, 4); return x; }
+  default: { double x; memcpy(&x, b, 8); return x; }
+  }
+}
+
+static void
+ply_vertex(struct model *m, struct element *e, double *value) {
+  static const char *names[ATTRIBUTES][3][3] = {
+    {{"x"}, {"y"}, {"z"}},
+    {{"nx"}, {"ny"}, {"nz"}},
+    {{"s", "u", "texture_u"}, {"t", "v", "texture_v"}},
+    {{"red", "r"}, {"green", "g"}, {"blue", "b"}},
+  };
+
+  uint32_t v = new_vertex(m);
+
+  for(int a=0; a<ATTRIBUTES; a++)
+    for(uint32_t c=0; c<attributes[a].components; c++)
+      for(size_t p=0; p<e->properties; p++)
+        for(int n=0; n<3 && names[a][c][n]; n++)
+          if (strcmp(e->property[p].name, names[a][c][n]) == 0) {
+            double x = value[p];
+            if (a == COLOR && e->property[p].type == 1)
+              x /= 255.0;
+            vertex(m, a, v)[c] = x;
+            m->present[a] = true;
+          }
+}
+
+static void
+read_ply(FILE *f, struct model *m) {
+  struct element element[8];
+  size_t elements = 0;
+  enum ply_format format = PLY_ASCII;
+  char line[1024];
+
+  if (!fgets(line, sizeof(line), f) || strncmp(line, "ply", 3) != 0)
+    DIE("not a ply file");
+
+  while(fgets(line, sizeof(line), f)) {
+    char a[64], b[64], c[64], d[64];
+    int n = sscanf(line, "%63s %63s %63s %63s %63s", a, b, c, d, d);
+
+    if (n >= 2 && strcmp(a, "format") == 0) {
+      if (strcmp(b, "ascii") == 0)
+        format = PLY_ASCII;
+      else if (strcmp(b, "binary_little_endian") == 0)
+        format = PLY_LITTLE;
+      else if (strcmp(b, "binary_big_endian") == 0)
+        format = PLY_BIG;
+      else
+        DIE("unknown ply format %s", b);
+    } else if (n == 3 && strcmp(a, "element") == 0) {
+      if (elements == 8)
+        DIE("too many ply elements");
+      struct element *e = &element[elements++];
+      memset(e, 0, sizeof(*e));
+      snprintf(e->name, sizeof(e->name), "%s", b);
+      e->count = strtoull(c, NULL, 10);
+    } else if (n >= 3 && strcmp(a, "property") == 0) {
+      if (elements == 0 || element[elements-1].properties == 32)
+        DIE("bad ply property");
+      struct element *e = &element[elements-1];
+      struct property *p = &e->property[e->properties++];
+      if (strcmp(b, "list") == 0) {
+        if (sscanf(line, "%*s %*s %63s %63s %63s", a, b, c) != 3)
+          DIE("bad ply list property");
+        p->count_type = ply_type(a) + 1;
+        p->type = ply_type(b);
+        snprintf(p->name, sizeof(p->name), "%s", c);
+      } else {
+        p->type = ply_type(b);
+        snprintf(p->name, sizeof(p->name), "%s", c);
+      }
+    } else if (n >= 1 && strcmp(a, "end_header") == 0) {
+      break;
+    }
+  }
+
+  for(size_t i=0; i<elements; i++) {
+    struct element *e = &element[i];
+    bool vertices = strcmp(e->name, "vertex") == 0;
+    bool faces = strcmp(e->name, "face") == 0;
+
+    for(size_t k=0; k<e->count; k++) {
+      double value[32];
+
+      for(size_t p=0; p<e->properties; p++) {
+        struct property *q = &e->property[p];
+
+        if (!q->count_type) {
+          value[p] = ply_read(f, format, q->type);
+          continue;
+        }
+
+        size_t count = ply_read(f, format, q->count_type - 1);
+        bool indices = faces && (strcmp(q->name, "vertex_indices") == 0 || strcmp(q->name, "vertex_index") == 0);
+        uint32_t first = 0, prev = 0;
+
+        for(size_t j=0; j<count; j++) {
+          double x = ply_read(f, format, q->type);
+          if (!indices)
+            continue;
+          if (x < 0 || x >= m->vertices)
+            DIE("face index out of range");
+          if (j == 0)
+            first = x;
+          else if (j >= 2) {
+            push_index(m, first);
+            push_index(m, prev);
+            push_index(m, x);
+          }
+          prev = x;
+        }
+      }
+
+      if (vertices)
+        ply_vertex(m, e, value);
+    }
+  }
+
+  if (!m->present[POSITION])
+    DIE("ply has no vertex positions");
+}
+
+
+static void
+pad(FILE *f, uint64_t *offset) {
+  static const char zero[MESH_ALIGN];
+  uint64_t n = (MESH_ALIGN - *offset % MESH_ALIGN) % MESH_ALIGN;
+  if (fwrite(zero, 1, n, f) != n)
+    DIE("write failed");
+  *offset += n;
+}
+
+static void
+write_mesh(FILE *f, struct model *m) {
+  struct mesh_header h = {MESH_MAGIC, MESH_VERSION, 0, m->vertices, m->index.size / sizeof(uint32_t), 0, {0}, {0}};
+  struct mesh_attribute a[ATTRIBUTES];
+  uint64_t offset;
+
+  for(size_t v=0; v<m->vertices; v++)
+    for(int c=0; c<3; c++) {
+      float x = vertex(m, POSITION, v)[c];
+      if (v == 0 || x < h.lo[c])
+        h.lo[c] = x;
+      if (v == 0 || x > h.hi[c])
+        h.hi[c] = x;
+    }
+
+  for(int i=0; i<ATTRIBUTES; i++)
+    if (m->present[i])
+      h.attributes++;
+
+  offset = sizeof(h) + h.attributes * sizeof(struct mesh_attribute);
+  offset = (offset + MESH_ALIGN - 1) / MESH_ALIGN * MESH_ALIGN;
+
+  for(int i=0, j=0; i<ATTRIBUTES; i++) {
+    if (!m->present[i])
+      continue;
+    memset(&a[j], 0, sizeof(a[j]));
+    snprintf(a[j].name, sizeof(a[j].name), "%s", attributes[i].name);
+    a[j].type = MESH_FLOAT32;
+    a[j].components = attributes[i].components;
+    a[j].stride = attributes[i].stride;
+    a[j].offset = offset;
+    offset += m->vertex[i].size;
+    offset = (offset + MESH_ALIGN - 1) / MESH_ALIGN * MESH_ALIGN;
+    ++j;
+  }
+  h.index_offset = offset;
+
+  if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(a, sizeof(a[0]), h.attributes, f) != h.attributes)
+    DIE("write failed");
+
+  offset = sizeof(h) + h.attributes * sizeof(struct mesh_attribute);
+  pad(f, &offset);
+
+  for(int i=0; i<ATTRIBUTES; i++) {
+    if (!m->present[i])
+      continue;
+    if (fwrite(m->vertex[i].data, 1, m->vertex[i].size, f) != m->vertex[i].size)
+      DIE("write failed");
+    offset += m->vertex[i].size;
+    pad(f, &offset);
+  }
+
+  if (fwrite(m->index.data, 1, m->index.size, f) != m->index.size)
+    DIE("write failed");
+}
+
+int
+main(int argc, char *argv[]) {
+  if (argc != 3)
+    DIE("usage: %s input.obj|input.ply output.mesh", argv[0]);
+
+  FILE *in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  struct model m = {0};
+  const char *ext = strrchr(argv[1], '.');
+
+  if (ext && strcasecmp(ext, ".obj") == 0)
+    read_obj(in, &m);
+  else if (ext && strcasecmp(ext, ".ply") == 0)
+    read_ply(in, &m);
+  else
+    DIE("%s: expected .obj or .ply", argv[1]);
+  fclose(in);
+
+  FILE *out = fopen(argv[2], "wb");
+  if (!out) {
+    perror(argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  write_mesh(out, &m);
+  if (fclose(out) != 0) {
+    perror(argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stderr, "%s: %zu vertices, %zu triangles\n", argv[2], m.vertices, m.index.size / sizeof(uint32_t) / 3);
+  return EXIT_SUCCESS;
+}
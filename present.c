@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include "present.h"
+
+bool present_enabled = false;
+
+static const char *present_path;
+static clockid_t clock_id = CLOCK_MONOTONIC;
+static struct present_frame frames[PRESENT_FRAMES];
+static uint32_t next;
+static uint64_t presented, discarded, missed;
+static uint64_t last_seq;
+static uint32_t last_refresh;
+
+uint64_t
+present_now(void) {
+  struct timespec ts;
+  clock_gettime(clock_id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+present_clock(clockid_t clock) {
+  clock_id = clock;
+}
+
+/* the record of frame, or NULL once the ring has moved past it */
+static struct present_frame *
+lookup(uint32_t frame) {
+  if (next - frame > PRESENT_FRAMES || frame == next)
+    return NULL;
+  return &frames[frame % PRESENT_FRAMES];
+}
+
+uint32_t
+present_begin(uint32_t callback_ms) {
+  uint32_t frame = next++;
+  frames[frame % PRESENT_FRAMES] = (struct present_frame){ .callback_ms = callback_ms, .callback = present_now() };
+  return frame;
+}
+
+void
+present_mark(uint32_t frame, enum present_stage stage) {
+  struct present_frame *f = lookup(frame);
+  if (!f)
+    return;
+
+  uint64_t now = present_now();
+  switch(stage) {
+  case PRESENT_RENDER_BEGIN:
+    f->render_begin = now;
+    break;
+  case PRESENT_RENDER_END:
+    f->render_end = now;
+    break;
+  case PRESENT_COMMIT:
+    f->commit = now;
+    break;
+  }
+}
+
+void
+present_presented(uint32_t frame, uint64_t timestamp, uint32_t refresh, uint64_t seq, uint32_t flags) {
+  struct present_frame *f = lookup(frame);
+
+  if (presented > 0 && seq > last_seq + 1)
+    missed += seq - last_seq - 1;
+  last_seq = seq;
+  last_refresh = refresh;
+  presented++;
+
+  if (f) {
+    f->presented = timestamp;
+    f->refresh = refresh;
+    f->seq = seq;
+    f->flags = flags;
+    f->done = true;
+  }
+
+  if (present_enabled && presented % PRESENT_PERIOD == 0)
+    present_dump();
+}
+
+void
+present_discarded(uint32_t frame) {
+  struct present_frame *f = lookup(frame);
+
+  discarded++;
+  if (f) {
+    f->done = true;
+    f->discarded = true;
+  }
+}
+
+static int
+compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* nearest rank percentile of n sorted values */
+static double
+percentile(const double *v, size_t n, double p) {
+  if (n == 0)
+    return 0.0;
+  size_t rank = (size_t)(p * n + 0.999999);
+  return v[(rank > 0 ? rank : 1) - 1];
+}
+
+void
+present_stats(struct present_stats *stats) {
+  static double latency[PRESENT_FRAMES], render[PRESENT_FRAMES];
+  size_t n = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->frames = next;
+  stats->presented = presented;
+  stats->discarded = discarded;
+  stats->missed = missed;
+  stats->refresh = last_refresh / 1e6;
+
+  for(size_t i=0; i<PRESENT_FRAMES && i<next; i++) {
+    const struct present_frame *f = &frames[i];
+    if (!f->done || f->discarded || f->presented < f->callback)
+      continue;
+
+    latency[n] = (f->presented - f->callback) / 1e6;
+    render[n] = (f->render_end - f->render_begin) / 1e6;
+
+    size_t bucket = (size_t)latency[n];
+    stats->histogram[bucket < PRESENT_BUCKETS ? bucket : PRESENT_BUCKETS - 1]++;
+    n++;
+  }
+
+  qsort(latency, n, sizeof(double), compare);
+  qsort(render, n, sizeof(double), compare);
+
+  stats->latency_p50 = percentile(latency, n, 0.50);
+  stats->latency_p90 = percentile(latency, n, 0.90);
+  stats->latency_p99 = percentile(latency, n, 0.99);
+  stats->latency_max = n ? latency[n-1] : 0.0;
+  stats->render_p50 = percentile(render, n, 0.50);
+  stats->render_p99 = percentile(render, n, 0.99);
+}
+
+void
+present_print(FILE *f, const struct present_stats *s) {
+  fprintf(f,
+          "frames %llu presented %llu discarded %llu missed %llu\n"
+          "latency ms p50 %.2f p90 %.2f p99 %.2f max %.2f\n"
+          "render ms p50 %.2f p99 %.2f refresh %.2f\n",
+          (unsigned long long)s->frames,
+          (unsigned long long)s->presented,
+          (unsigned long long)s->discarded,
+          (unsigned long long)s->missed,
+          s->latency_p50, s->latency_p90, s->latency_p99, s->latency_max,
+          s->render_p50, s->render_p99, s->refresh);
+}
+
+void
+present_json(FILE *f, const struct present_stats *s) {
+  fprintf(f,
+          "{\"frames\":%llu,\"presented\":%llu,\"discarded\":%llu,\"missed\":%llu,"
+          "\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+          "\"render_ms\":{\"p50\":%.3f,\"p99\":%.3f},\"refresh_ms\":%.3f,\"histogram_ms\":[",
+          (unsigned long long)s->frames,
+          (unsigned long long)s->presented,
+          (unsigned long long)s->discarded,
+          (unsigned long long)s->missed,
+          s->latency_p50, s->latency_p90, s->latency_p99, s->latency_max,
+          s->render_p50, s->render_p99, s->refresh);
+
+  for(size_t i=0; i<PRESENT_BUCKETS; i++)
+    fprintf(f, "%s%llu", i ? "," : "", (unsigned long long)s->histogram[i]);
+  fprintf(f, "]}\n");
+}
+
+void
+present_dump(void) {
+  if (!present_enabled)
+    return;
+
+  struct present_stats stats;
+  present_stats(&stats);
+  present_print(stderr, &stats);
+
+  FILE *f = fopen(present_path, "w");
+  if (!f) {
+    perror(present_path);
+    return;
+  }
+  present_json(f, &stats);
+  fclose(f);
+}
+
+void
+present_init(void) {
+  present_path = getenv("TRIANGLE_LATENCY");
+  if (!present_path || !*present_path)
+    return;
+
+  present_enabled = true;
+  atexit(present_dump);
+}
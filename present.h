@@ -0,0 +1,74 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Present-to-photon statistics. Each frame records, in nanoseconds of the
+ * presentation clock, when the frame callback fired, when rendering began
+ * and ended, when the surface was committed, and when the compositor
+ * reported the frame shown. Latency is from the frame callback, where input
+ * would be sampled, to presentation. A refresh is missed when it passes
+ * between two presented frames without a new one; discarded frames were
+ * replaced before they could be shown.
+ */
+
+#define PRESENT_FRAMES 1024
+#define PRESENT_BUCKETS 64
+#define PRESENT_PERIOD 600
+
+enum present_stage {
+  PRESENT_RENDER_BEGIN,
+  PRESENT_RENDER_END,
+  PRESENT_COMMIT
+};
+
+struct present_frame {
+  uint32_t callback_ms;
+  uint64_t callback;
+  uint64_t render_begin;
+  uint64_t render_end;
+  uint64_t commit;
+  uint64_t presented;
+  uint64_t seq;
+  uint32_t refresh;
+  uint32_t flags;
+  bool done;
+  bool discarded;
+};
+
+struct present_stats {
+  uint64_t frames;
+  uint64_t presented;
+  uint64_t discarded;
+  uint64_t missed;
+  /* milliseconds, over the last PRESENT_FRAMES presented frames */
+  double latency_p50, latency_p90, latency_p99, latency_max;
+  double render_p50, render_p99;
+  double refresh;
+  /* latency in 1 ms buckets, the last holding everything longer */
+  uint64_t histogram[PRESENT_BUCKETS];
+};
+
+extern bool present_enabled;
+
+void present_init(void);
+void present_clock(clockid_t clock);
+uint64_t present_now(void);
+uint32_t present_begin(uint32_t callback_ms);
+void present_mark(uint32_t frame, enum present_stage stage);
+void present_presented(uint32_t frame, uint64_t timestamp, uint32_t refresh, uint64_t seq, uint32_t flags);
+void present_discarded(uint32_t frame);
+void present_stats(struct present_stats *stats);
+void present_print(FILE *f, const struct present_stats *stats);
+void present_json(FILE *f, const struct present_stats *stats);
+void present_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,352 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__F16C__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
+namespace gl {
+  inline namespace GL_ISA {
+  namespace sl {
+    // Q16.16 two's complement; results saturate instead of wrapping
+    struct fixed {
+      ::std::int32_t raw;
+
+      fixed() = default;
+
+      template<typename U, typename = ::std::enable_if_t<::std::is_arithmetic<U>::value>>
+      constexpr fixed(U v) : raw(encode(v)) { }
+
+      template<typename U, typename = ::std::enable_if_t<::std::is_arithmetic<U>::value>>
+      explicit
+      constexpr
+      operator U() const {
+        if constexpr (::std::is_same<U, bool>::value)
+          return raw != 0;
+        else if constexpr (::std::is_floating_point<U>::value)
+          return U(raw) * U(1.0/65536);
+        else
+          return U(raw / 65536);
+      }
+
+      static
+      constexpr
+      fixed
+      from_raw(::std::int64_t r) {
+        fixed f {};
+        f.raw = ::std::int32_t(r < INT32_MIN ? INT32_MIN : r > INT32_MAX ? INT32_MAX : r);
+        return f;
+      }
+
+      template<typename U>
+      static
+      constexpr
+      ::std::int32_t
+      encode(U v) {
+        if constexpr (::std::is_floating_point<U>::value) {
+          double r = double(v) * 65536.0 + (v < 0 ? -0.5 : 0.5);
+          return (r != r) ? 0 : from_raw(r < INT32_MIN ? INT32_MIN : r > INT32_MAX ? INT32_MAX : ::std::int64_t(r)).raw;
+        } else {
+          return from_raw(::std::int64_t(v) * 65536).raw;
+        }
+      }
+
+      friend constexpr fixed operator+(fixed a, fixed b) { return from_raw(::std::int64_t(a.raw) + b.raw); }
+      friend constexpr fixed operator-(fixed a, fixed b) { return from_raw(::std::int64_t(a.raw) - b.raw); }
+      friend constexpr fixed operator-(fixed a) { return from_raw(-::std::int64_t(a.raw)); }
+      friend constexpr fixed operator*(fixed a, fixed b) { return from_raw((::std::int64_t(a.raw) * b.raw + 0x8000) >> 16); }
+
+      friend
+      constexpr
+      fixed
+      operator/(fixed a, fixed b) {
+        if (b.raw == 0)
+          return from_raw(a.raw < 0 ? INT32_MIN : INT32_MAX);
+        return from_raw(::std::int64_t(a.raw) * 65536 / b.raw);
+      }
+
+      constexpr fixed& operator+=(fixed b) { return *this = *this + b; }
+      constexpr fixed& operator-=(fixed b) { return *this = *this - b; }
+      constexpr fixed& operator*=(fixed b) { return *this = *this * b; }
+      constexpr fixed& operator/=(fixed b) { return *this = *this / b; }
+
+      friend constexpr bool operator==(fixed a, fixed b) { return a.raw == b.raw; }
+      friend constexpr bool operator!=(fixed a, fixed b) { return a.raw != b.raw; }
+      friend constexpr bool operator<(fixed a, fixed b) { return a.raw < b.raw; }
+      friend constexpr bool operator<=(fixed a, fixed b) { return a.raw <= b.raw; }
+      friend constexpr bool operator>(fixed a, fixed b) { return a.raw > b.raw; }
+      friend constexpr bool operator>=(fixed a, fixed b) { return a.raw >= b.raw; }
+    };
+
+    // IEEE binary16 storage; arithmetic promotes to float
+    struct half {
+      ::std::uint16_t bits;
+
+      half() = default;
+
+      template<typename U, typename = ::std::enable_if_t<::std::is_arithmetic<U>::value>>
+      half(U v) : bits(encode(float(v))) { }
+
+      operator float() const { return decode(bits); }
+
+      half& operator+=(float v) { return *this = float(*this) + v; }
+      half& operator-=(float v) { return *this = float(*this) - v; }
+      half& operator*=(float v) { return *this = float(*this) * v; }
+      half& operator/=(float v) { return *this = float(*this) / v; }
+
+#ifdef __F16C__
+      static float decode(::std::uint16_t h) { return _cvtsh_ss(h); }
+      static ::std::uint16_t encode(float f) { return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT); }
+#else
+      static
+      float
+      decode(::std::uint16_t h) {
+        ::std::uint32_t sign = ::std::uint32_t(h & 0x8000) << 16;
+        ::std::uint32_t e = (h >> 10) & 0x1f;
+        ::std::uint32_t m = h & 0x3ff;
+        ::std::uint32_t x;
+
+        if (e == 0) {
+          float f = float(m) * (1.0f / 16777216.0f);
+          return sign ? -f : f;
+        }
+
+        if (e == 0x1f)
+          x = sign | 0x7f800000 | (m << 13);
+        else
+          x = sign | ((e + 112) << 23) | (m << 13);
+
+        float f;
+        ::std::memcpy(&f, &x, sizeof(f));
+        return f;
+      }
+
+      static
+      ::std::uint16_t
+      encode(float f) {
+        ::std::uint32_t x;
+        ::std::memcpy(&x, &f, sizeof(x));
+
+        ::std::uint16_t sign = (x >> 16) & 0x8000;
+        ::std::uint32_t a = x & 0x7fffffff;
+
+        if (a > 0x7f800000)
+          return sign | 0x7e00 | ((a >> 13) & 0x3ff);
+        if (a >= 0x477ff000)
+          return sign | 0x7c00;
+        if (a < 0x38800000)
+          return sign | ::std::uint16_t(::std::nearbyint(::std::abs(f) * 16777216.0f));
+
+        a -= 0x38000000;
+        a += 0xfff + ((a >> 13) & 1);
+        return sign | ::std::uint16_t(a >> 13);
+      }
+#endif
+    };
+
+    // One float per vertex of a group shaded together; arithmetic is lane-wise.
+    // There are no comparisons, since a shader cannot branch on them.
+    struct float8 {
+      static constexpr ::std::size_t LANES = 8;
+
+#if defined(__AVX__)
+      union {
+        __m256 m;
+        float lane[LANES];
+      };
+#else
+      alignas(16) float lane[LANES];
+#endif
+
+      float8() = default;
+
+      template<typename U, typename = ::std::enable_if_t<::std::is_arithmetic<U>::value>>
+      constexpr float8(U v) : lane {float(v), float(v), float(v), float(v), float(v), float(v), float(v), float(v)} { }
+
+      float& operator[](::std::size_t i) { return lane[i]; }
+      float const& operator[](::std::size_t i) const { return lane[i]; }
+
+      template<typename F>
+      static
+      float8
+      map(F const& f, float8 const& a) {
+        float8 r;
+        for(::std::size_t i=0; i<LANES; i++)
+          r.lane[i] = f(a.lane[i]);
+        return r;
+      }
+
+      template<typename F>
+      static
+      float8
+      map(F const& f, float8 const& a, float8 const& b) {
+        float8 r;
+        for(::std::size_t i=0; i<LANES; i++)
+          r.lane[i] = f(a.lane[i], b.lane[i]);
+        return r;
+      }
+
+#if defined(__AVX__)
+      friend float8 operator+(float8 const& a, float8 const& b) { return _mm256_add_ps(a.m256(), b.m256()); }
+      friend float8 operator-(float8 const& a, float8 const& b) { return _mm256_sub_ps(a.m256(), b.m256()); }
+      friend float8 operator*(float8 const& a, float8 const& b) { return _mm256_mul_ps(a.m256(), b.m256()); }
+      friend float8 operator/(float8 const& a, float8 const& b) { return _mm256_div_ps(a.m256(), b.m256()); }
+
+      float8(__m256 v) : m(v) { }
+      __m256 m256() const { return m; }
+
+      float8(__m128 lo, __m128 hi) : m(_mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1)) { }
+      __m128 quad(::std::size_t h) const { return h ? _mm256_extractf128_ps(m, 1) : _mm256_castps256_ps128(m); }
+#else
+      friend float8 operator+(float8 const& a, float8 const& b) { return map([](float x, float y){ return x + y; }, a, b); }
+      friend float8 operator-(float8 const& a, float8 const& b) { return map([](float x, float y){ return x - y; }, a, b); }
+      friend float8 operator*(float8 const& a, float8 const& b) { return map([](float x, float y){ return x * y; }, a, b); }
+      friend float8 operator/(float8 const& a, float8 const& b) { return map([](float x, float y){ return x / y; }, a, b); }
+
+#ifdef __SSE2__
+      float8(__m128 lo, __m128 hi) { _mm_store_ps(lane, lo); _mm_store_ps(lane + 4, hi); }
+      __m128 quad(::std::size_t h) const { return _mm_load_ps(lane + 4*h); }
+#endif
+#endif
+      friend float8 operator-(float8 const& a) { return map([](float x){ return -x; }, a); }
+
+      float8& operator+=(float8 const& b) { return *this = *this + b; }
+      float8& operator-=(float8 const& b) { return *this = *this - b; }
+      float8& operator*=(float8 const& b) { return *this = *this * b; }
+      float8& operator/=(float8 const& b) { return *this = *this / b; }
+    };
+
+    template<typename T>
+    constexpr
+    bool SCALAR_TYPE = ::std::is_arithmetic<T>::value;
+
+    template<>
+    constexpr
+    bool SCALAR_TYPE<fixed> = true;
+
+    template<>
+    constexpr
+    bool SCALAR_TYPE<half> = true;
+
+    template<>
+    constexpr
+    bool SCALAR_TYPE<float8> = true;
+
+    // the type gl_Position and the rasterizer work in for a given shader scalar
+    template<typename T>
+    struct WIDEN {
+      using TYPE = T;
+    };
+
+    template<>
+    struct WIDEN<fixed> {
+      using TYPE = float;
+    };
+
+    template<>
+    struct WIDEN<half> {
+      using TYPE = float;
+    };
+
+    constexpr
+    fixed
+    abs(fixed x) {
+      return x < 0 ? -x : x;
+    }
+
+    constexpr
+    fixed
+    floor(fixed x) {
+      return fixed::from_raw(x.raw & ~0xffff);
+    }
+
+    constexpr
+    fixed
+    ceil(fixed x) {
+      return fixed::from_raw((::std::int64_t(x.raw) + 0xffff) & ~::std::int64_t(0xffff));
+    }
+
+    constexpr
+    fixed
+    fract(fixed x) {
+      return fixed::from_raw(x.raw & 0xffff);
+    }
+
+#define _FIXED_MATH1(f) inline fixed f(fixed x) { return ::std::f(float(x)); }
+#define _FIXED_MATH2(f, g) inline fixed f(fixed x, fixed y) { return ::std::g(float(x), float(y)); }
+
+    _FIXED_MATH1(sin) _FIXED_MATH1(cos) _FIXED_MATH1(tan)
+    _FIXED_MATH1(asin) _FIXED_MATH1(acos) _FIXED_MATH1(atan)
+    _FIXED_MATH1(exp) _FIXED_MATH1(exp2) _FIXED_MATH1(log) _FIXED_MATH1(log2)
+    _FIXED_MATH1(sqrt)
+    _FIXED_MATH2(atan, atan2) _FIXED_MATH2(pow, pow)
+
+#undef _FIXED_MATH1
+#undef _FIXED_MATH2
+
+    inline
+    fixed
+    inversesqrt(fixed x) {
+      return 1.0f / ::std::sqrt(float(x));
+    }
+
+#define _FLOAT8_MATH1(f) inline float8 f(float8 const& x) { return float8::map([](float a){ return ::std::f(a); }, x); }
+#define _FLOAT8_MATH2(f, g) inline float8 f(float8 const& x, float8 const& y) { return float8::map([](float a, float b){ return ::std::g(a, b); }, x, y); }
+
+    _FLOAT8_MATH1(sin) _FLOAT8_MATH1(cos) _FLOAT8_MATH1(tan)
+    _FLOAT8_MATH1(asin) _FLOAT8_MATH1(acos) _FLOAT8_MATH1(atan)
+    _FLOAT8_MATH1(exp) _FLOAT8_MATH1(exp2) _FLOAT8_MATH1(log) _FLOAT8_MATH1(log2)
+    _FLOAT8_MATH1(abs) _FLOAT8_MATH1(floor) _FLOAT8_MATH1(ceil)
+    _FLOAT8_MATH2(atan, atan2) _FLOAT8_MATH2(pow, pow)
+
+#undef _FLOAT8_MATH1
+#undef _FLOAT8_MATH2
+
+    inline
+    float8
+    min(float8 const& x, float8 const& y) {
+      return float8::map([](float a, float b){ return (b < a) ? b : a; }, x, y);
+    }
+
+    inline
+    float8
+    max(float8 const& x, float8 const& y) {
+      return float8::map([](float a, float b){ return (a < b) ? b : a; }, x, y);
+    }
+
+    inline
+    float8
+    sqrt(float8 const& x) {
+      float8 r;
+#if defined(__AVX__)
+      r.m = _mm256_sqrt_ps(x.m);
+#elif defined(__SSE2__)
+      _mm_store_ps(r.lane, _mm_sqrt_ps(_mm_load_ps(x.lane)));
+      _mm_store_ps(r.lane + 4, _mm_sqrt_ps(_mm_load_ps(x.lane + 4)));
+#else
+      r = float8::map([](float a){ return ::std::sqrt(a); }, x);
+#endif
+      return r;
+    }
+
+    inline
+    float8
+    inversesqrt(float8 const& x) {
+      return float8(1.0f) / sqrt(x);
+    }
+
+    inline
+    float8
+    fract(float8 const& x) {
+      return x - floor(x);
+    }
+  }
+  }
+}
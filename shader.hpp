@@ -3,10 +3,17 @@
 #include <new>
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <type_traits>
 
 
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
 namespace gl {
+  inline namespace GL_ISA {
   namespace shader {
     using ::std::size_t;
 
@@ -42,6 +49,8 @@ namespace gl {
     template<typename K, typename L>
     using LOOKUP_T = typename LOOKUP<K,L>::TYPE;
 
+    template<typename, typename = void> struct LAYOUT;
+
     template<typename K, typename V, typename L, typename = void>
     struct INSERT {
       using TYPE = typename APPEND<L, PAIR<K,V>>::TYPE;
@@ -49,7 +58,7 @@ namespace gl {
 
     template<typename K, typename V, typename L>
     struct INSERT<K,V,L, ::std::void_t<LOOKUP_T<K,L>>> {
-      static_assert(::std::is_same<V, LOOKUP_T<K,L>>::value);
+      static_assert(::std::is_same<typename LAYOUT<V>::TYPE, typename LAYOUT<LOOKUP_T<K,L>>::TYPE>::value);
       using TYPE = L;
     };
 
@@ -107,18 +116,66 @@ namespace gl {
     constexpr
     size_t INDEX_OF<T, U, V...> = 1 + INDEX_OF<T, V...>;
 
-    template<typename N, typename T, typename V, V* T::* x>
+    template<typename N, typename T, typename V, auto x>
     struct MEMBER {
       using NAME = N;
       using TYPE = V;
       static constexpr auto POINTER = x;
     };
 
-    template<typename> struct BINDING_DATA;
+    struct storage_native {};
+    struct storage_half {};
+
+    struct vertex_scalar {};
+    struct vertex_simd {};
+
+    template<typename S, typename T>
+    struct STORAGE {
+      using TYPE = T;
+    };
+
+    template<>
+    struct STORAGE<storage_half, float> {
+      using TYPE = sl::half;
+    };
+
+    template<size_t N>
+    struct STORAGE<storage_half, sl::vec<N,float>> {
+      using TYPE = sl::vec<N,sl::half>;
+    };
+
+    template<size_t N>
+    struct STORAGE<storage_half, sl::mat<N,float>> {
+      using TYPE = sl::mat<N,sl::half>;
+    };
+
+    template<typename S, typename T>
+    using STORE = typename STORAGE<S,T>::TYPE;
 
-    template<typename... F>
-    struct BINDING_DATA<LIST<F...>> {
+    // folds size bytes at p into h, eight at a time
+    inline
+    ::std::uint64_t
+    hash_bytes(::std::uint64_t h, void const *p, size_t size) {
+      auto c = (unsigned char const *)p;
+
+      for(; size >= 8; size -= 8, c += 8) {
+        ::std::uint64_t w;
+        ::std::memcpy(&w, c, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15u;
+        h ^= h >> 29;
+      }
+
+      for(; size > 0; size--, c++)
+        h = (h ^ *c) * 0x100000001b3u;
+      return h;
+    }
+
+    template<typename, typename = storage_native> struct BINDING_DATA;
+
+    template<typename... F, typename S>
+    struct BINDING_DATA<LIST<F...>, S> {
       using FIELDS = LIST<F...>;
+      using POLICY = S;
       void *ptr[sizeof...(F)];
 
       template<typename T>
@@ -128,24 +185,51 @@ namespace gl {
         ptr[INDEX_OF<T, typename F::NAME...>] = p;
       }
 
+      template<typename T>
+      inline
+      LOOKUP_T<T, FIELDS> *
+      get() {
+        return (LOOKUP_T<T, FIELDS> *)ptr[INDEX_OF<T, typename F::NAME...>];
+      }
+
       template<typename T, typename... M>
       inline
       void
       bind(T *x [[ gnu::unused ]], size_t n [[ gnu::unused ]]) {
-        auto f [[ gnu::unused ]] = [](auto&a, auto *p){a = p;};
+        auto f [[ gnu::unused ]] = [](auto&a, auto *p){a = (::std::remove_reference_t<decltype(a)>)p;};
         (f(x->*(M::POINTER), lookup<M>(n)),...);
       }
 
+      template<typename T>
+      inline
+      STORE<S, LOOKUP_T<T, FIELDS>> *
+      at(size_t n) {
+        return (STORE<S, LOOKUP_T<T, FIELDS>> *)ptr[INDEX_OF<T, typename F::NAME...>] + n;
+      }
+
       template<typename M>
       inline
-      typename M::TYPE *
+      STORE<S, typename M::TYPE> *
       lookup(size_t n) {
-        return ((typename M::TYPE *)(ptr[INDEX_OF<typename M::NAME, typename F::NAME...>]) + n);
+        return ((STORE<S, typename M::TYPE> *)(ptr[INDEX_OF<typename M::NAME, typename F::NAME...>]) + n);
+      }
+
+      // folds element n of every field that is set into h
+      ::std::uint64_t
+      hash(size_t n [[ gnu::unused ]], ::std::uint64_t h) const {
+        size_t i = 0;
+        auto f [[ gnu::unused ]] = [&](size_t size) {
+          if (ptr[i])
+            h = hash_bytes(h, (char const *)ptr[i] + n*size, size);
+          ++i;
+        };
+        (f(sizeof(STORE<S, typename F::TYPE>)),...);
+        return h;
       }
 
       void
       alloc(size_t n) {
-        new (&ptr) decltype(ptr) {::std::malloc(sizeof(typename F::TYPE)*n)...};
+        new (&ptr) decltype(ptr) {::std::malloc(sizeof(STORE<S, typename F::TYPE>)*n)...};
       }
 
       void
@@ -156,9 +240,9 @@ namespace gl {
 
     };
 
-    template<typename FIELDS, typename ...M>
+    template<typename FIELDS, typename S, typename ...M>
     struct BINDING {
-      BINDING_DATA<FIELDS> data;
+      BINDING_DATA<FIELDS, S> data;
 
       template<typename T>
       inline
@@ -167,6 +251,13 @@ namespace gl {
         data.template set<T>(p);
       }
 
+      template<typename T>
+      inline
+      LOOKUP_T<T, FIELDS> *
+      get(T) {
+        return data.template get<T>();
+      }
+
       template<typename T, typename... L>
       inline
       void
@@ -214,6 +305,7 @@ namespace gl {
     template<typename T> struct T_uniform;
     template<typename T> struct T_attribute;
     template<typename T> struct T_varying;
+    template<typename T> struct T_field;
 
     template<typename T, size_t = sizeof(T)>
     constexpr
@@ -230,7 +322,7 @@ namespace gl {
     }
 
     template<template<typename> typename TYPE,
-             typename T, typename N, typename V, V* T::* M,
+             typename T, typename N, typename V, auto M,
              typename = ::std::enable_if_t<not defined<T>(0)>,
              size_t C = next<TYPE<T>>(0),
              typename = ::std::enable_if_t<(C > 0)>,
@@ -262,19 +354,104 @@ namespace gl {
              >
     using MEMBERS = State;
 
+    template<typename> struct LAYOUT_OF;
+
+    template<typename... M>
+    struct LAYOUT_OF<LIST<M...>> {
+      using TYPE = LIST<PAIR<typename M::NAME, typename LAYOUT<typename M::TYPE>::TYPE>...>;
+    };
+
+    template<typename T, typename>
+    struct LAYOUT {
+      using TYPE = T;
+    };
+
+    template<typename T>
+    struct LAYOUT<T, ::std::void_t<MEMBERS<T_field, T>>> {
+      using TYPE = typename LAYOUT_OF<MEMBERS<T_field, T>>::TYPE;
+    };
+
+    template<typename... T>
+    constexpr
+    size_t
+    MAX_ALIGN() {
+      size_t a = 1;
+      ((a = (alignof(T) > a) ? alignof(T) : a), ...);
+      return a;
+    }
+
+    template<typename... M>
+    struct SLOTS {
+      static constexpr size_t ALIGN = MAX_ALIGN<typename M::TYPE...>();
+
+      static
+      constexpr
+      size_t
+      SLOT(size_t size) {
+        return (size + ALIGN - 1) / ALIGN * ALIGN;
+      }
+
+      alignas(ALIGN) char buf[(0 + ... + SLOT(sizeof(typename M::TYPE)))];
+    };
+
     template<typename Program, typename... M>
-    struct INTERPOLATION {
-      char buf[(0 + ... + sizeof(typename M::TYPE))];
+    struct OUTPUT : SLOTS<M...> {
+      using SLOTS<M...>::SLOT;
+      using SLOTS<M...>::buf;
+
+      using DATA = decltype(Program::varying.data);
+
+      static constexpr bool DIRECT = (true && ... && ::std::is_same<typename M::TYPE, STORE<typename DATA::POLICY, typename M::TYPE>>::value);
+
+      DATA& data;
+      size_t n;
+
+      OUTPUT(DATA& data, typename Program::Vertex *v, size_t n) : data(data), n(n) {
+        if constexpr (DIRECT) {
+          data.template bind<typename Program::Vertex, M...>(v, n);
+        } else {
+          char *p = buf;
+
+          auto f [[ gnu::unused ]] = [v,&p](size_t size, auto m) {
+            v->*m = (::std::remove_reference_t<decltype(v->*m)>)p;
+            p += size;
+          };
+
+          (f(SLOT(sizeof(typename M::TYPE)), M::POINTER),...);
+        }
+      }
+
+      void
+      store() {
+        if constexpr (!DIRECT) {
+          char *p = buf;
+
+          auto f [[ gnu::unused ]] = [&p](size_t size, auto *x, auto *s) {
+            *s = ::std::remove_pointer_t<decltype(s)>(*((decltype(x))p));
+            p += size;
+          };
+
+          (f(SLOT(sizeof(typename M::TYPE)), (typename M::TYPE *)nullptr, data.template lookup<M>(n)),...);
+        }
+      }
+    };
+
+    template<typename Program, typename... M>
+    struct INTERPOLATION : SLOTS<M...> {
+      using SLOTS<M...>::SLOT;
+      using SLOTS<M...>::buf;
 
       INTERPOLATION(typename Program::vec3 const& P, decltype(Program::varying.data)& data, size_t i0, size_t i1, size_t i2) {
         char *p = buf;
 
-        auto f = [&p,&P](size_t size, auto*x, auto*y, auto*z){
-          *((decltype(x))p) = sl::interpolate(P, *x, *y, *z);
+        auto f = [&p,&P](size_t size, auto *r, auto*x, auto*y, auto*z){
+          using U = ::std::remove_pointer_t<decltype(r)>;
+          *((decltype(r))p) = sl::interpolate(P, U(*x), U(*y), U(*z));
           p += size;
         };
 
-        (f(sizeof(typename M::TYPE),
+        (f(SLOT(sizeof(typename M::TYPE)),
+           (typename M::TYPE *)nullptr,
            data.template lookup<M>(i0),
            data.template lookup<M>(i1),
            data.template lookup<M>(i2)),...);
@@ -289,16 +466,308 @@ namespace gl {
           p += size;
         };
 
-        (f(sizeof(typename M::TYPE), M::POINTER),...);
+        (f(SLOT(sizeof(typename M::TYPE)), M::POINTER),...);
       }
 
     };
 
-    template<typename T, template<typename> typename V, template<typename> typename F>
+    template<typename T, typename = void>
+    constexpr
+    bool BLOCK = false;
+
+    template<typename T>
+    constexpr
+    bool BLOCK<T, ::std::void_t<MEMBERS<T_field, T>>> = true;
+
+    template<typename U, typename S>
+    void broadcast(U& dst, S const& src);
+
+    template<typename U, typename S, typename... A, typename... B>
+    inline
+    void
+    broadcast(U& dst [[ gnu::unused ]], S const& src [[ gnu::unused ]], LIST<A...>, LIST<B...>) {
+      (broadcast(dst.*(A::POINTER), src.*(B::POINTER)),...);
+    }
+
+    // a uniform value for all lanes of its float8 counterpart
+    template<typename U, typename S>
+    inline
+    void
+    broadcast(U& dst, S const& src) {
+      if constexpr (::std::is_same<U, S>::value || ::std::is_arithmetic<S>::value)
+        dst = src;
+      else if constexpr (BLOCK<U>)
+        broadcast(dst, src, MEMBERS<T_field, U>(), MEMBERS<T_field, S>());
+      else
+        for(size_t i=0; i<U::SIZE; i++)
+          broadcast(dst[i], src[i]);
+    }
+
+    template<typename U, typename S>
+    inline
+    void
+    insert_lane(U& dst, S const& src, size_t l) {
+      static_assert(!::std::is_arithmetic<U>::value, "vertex_simd attributes must be float vectors");
+      if constexpr (::std::is_same<U, sl::float8>::value)
+        dst[l] = float(src);
+      else
+        for(size_t i=0; i<U::SIZE; i++)
+          insert_lane(dst[i], src[i], l);
+    }
+
+    template<typename S, typename U>
+    inline
+    void
+    extract_lane(S& dst, U const& src, size_t l) {
+      if constexpr (::std::is_same<U, sl::float8>::value)
+        dst = src[l];
+      else
+        for(size_t i=0; i<U::SIZE; i++)
+          extract_lane(dst[i], src[i], l);
+    }
+
+    template<typename U, typename S>
+    constexpr
+    bool TRANSPOSE = false;
+
+#ifdef __SSE2__
+    template<size_t N>
+    constexpr
+    bool TRANSPOSE<sl::vec<N,sl::float8>, sl::vec<N,float>> = sl::packed<N,float>;
+#endif
+
+    // lane l of dst from src[source[l]], for l < n; whole groups of packed
+    // vectors are loaded and transposed four lanes at a time
+    template<typename U, typename S>
+    inline
+    void
+    gather(U& dst, S const *src, size_t const *source, size_t n) {
+#ifdef __SSE2__
+      if constexpr (TRANSPOSE<U,S>) {
+        if (n == sl::float8::LANES) {
+          __m128 r[2][4];
+          for(size_t h=0; h<2; h++) {
+            for(size_t l=0; l<4; l++)
+              r[h][l] = src[source[4*h+l]].packet();
+            _MM_TRANSPOSE4_PS(r[h][0], r[h][1], r[h][2], r[h][3]);
+          }
+          for(size_t i=0; i<U::SIZE; i++)
+            dst[i] = sl::float8(r[0][i], r[1][i]);
+          return;
+        }
+      }
+#endif
+      for(size_t l=0; l<n; l++)
+        insert_lane(dst, src[source[l]], l);
+    }
+
+    // lane l of src as a T into dst[target[l]], for l < n
+    template<typename T, typename D, typename U>
+    inline
+    void
+    scatter(D *dst, U const& src, size_t const *target, size_t n) {
+#ifdef __SSE2__
+      if constexpr (TRANSPOSE<U,D>) {
+        for(size_t h=0; h<2 && 4*h<n; h++) {
+          __m128 r[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+          for(size_t i=0; i<U::SIZE; i++)
+            r[i] = src[i].quad(h);
+          _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+          for(size_t l=4*h; l<n && l<4*h+4; l++)
+            _mm_store_ps(dst[target[l]].data, r[l-4*h]);
+        }
+        return;
+      }
+#endif
+      for(size_t l=0; l<n; l++) {
+        T value;
+        extract_lane(value, src, l);
+        dst[target[l]] = D(value);
+      }
+    }
+
+    // points the members M of shader v at consecutive slots from p
+    template<typename S, typename... M>
+    inline
+    void
+    bind_slots(S *v [[ gnu::unused ]], char *p [[ gnu::unused ]], LIST<M...>) {
+      auto f [[ gnu::unused ]] = [v,&p](size_t size, auto m) {
+        v->*m = (::std::remove_reference_t<decltype(v->*m)>)p;
+        p += size;
+      };
+
+      (f(SLOTS<M...>::SLOT(sizeof(typename M::TYPE)), M::POINTER),...);
+    }
+
+    // the program's uniforms U, broadcast to all lanes, into consecutive slots from p
+    template<typename Program, typename... U>
+    inline
+    void
+    broadcast_slots(Program& prog [[ gnu::unused ]], char *p [[ gnu::unused ]], LIST<U...>) {
+      auto f [[ gnu::unused ]] = [&p](size_t size, auto *x, auto *s) {
+        auto u = new (p) ::std::remove_pointer_t<decltype(x)>;
+        if (s)
+          broadcast(*u, *s);
+        p += size;
+      };
+
+      (f(SLOTS<U...>::SLOT(sizeof(typename U::TYPE)), (typename U::TYPE *)nullptr, prog.uniform.get(typename U::NAME())),...);
+    }
+
+    // The float8 instance of a vertex_simd program's vertex shader, shading up to
+    // LANES vertices per run. Uniforms are broadcast once on construction,
+    // attributes gathered into lanes and varyings scattered back per run.
+    template<typename Program, typename U, typename A, typename V> struct GROUP;
+
+    template<typename Program, typename... U, typename... A, typename... V>
+    struct GROUP<Program, LIST<U...>, LIST<A...>, LIST<V...>> {
+      using Lanes = typename Program::VertexLanes;
+      using Float = sl::float8;
+
+      Program& prog;
+      SLOTS<U...> uniforms;
+      SLOTS<A...> attributes;
+      SLOTS<V...> varyings;
+      sl::vec<4,Float> position;
+      alignas(Lanes) char shader[sizeof(Lanes)] = {0};
+
+      GROUP(Program& prog) : prog(prog) {
+        auto v = (Lanes *)shader;
+        v->_ptr_gl_Position = &position;
+        bind_slots(v, uniforms.buf, LIST<U...>());
+        bind_slots(v, attributes.buf, LIST<A...>());
+        bind_slots(v, varyings.buf, LIST<V...>());
+        broadcast_slots(prog, uniforms.buf, LIST<U...>());
+      }
+
+      GROUP(GROUP const&) = delete;
+
+      void
+      run(size_t const *source [[ gnu::unused ]], size_t n [[ gnu::unused ]]) {
+        char *p = attributes.buf;
+
+        auto f [[ gnu::unused ]] = [&p,source,n](size_t size, auto *x, auto *s) {
+          gather(*x, s, source, n);
+          p += size;
+        };
+
+        (f(SLOTS<A...>::SLOT(sizeof(typename A::TYPE)), (typename A::TYPE *)p, prog.attribute.get(typename A::NAME())),...);
+        ((Lanes *)shader)->main();
+      }
+
+      // captures for transform feedback, then stores w times each varying
+      void
+      scatter(size_t const *source [[ gnu::unused ]], size_t const *target [[ gnu::unused ]], size_t n [[ gnu::unused ]], Float const& w [[ gnu::unused ]]) {
+        auto v = (Lanes *)shader;
+        auto f [[ gnu::unused ]] = [&](auto *x, auto *c, auto *d) {
+          using S = ::std::remove_pointer_t<decltype(c)>;
+          if (c)
+            shader::scatter<S>(c, *x, source, n);
+
+          *x = *x * w;
+          shader::scatter<S>(d, *x, target, n);
+        };
+
+        (f(v->*(V::POINTER), prog.feedback.get(typename V::NAME()), prog.varying.data.template at<typename V::NAME>(0)),...);
+      }
+    };
+
+    // The float8 instance of a fragment shader that samples textures, shading the
+    // sl::QUAD_LANES lanes texture2D takes the level of detail from in one run.
+    // Uniforms are broadcast once on construction, varyings interpolated per run.
+    template<typename Program, typename U, typename V> struct QUAD;
+
+    template<typename Program, typename... U, typename... V>
+    struct QUAD<Program, LIST<U...>, LIST<V...>> {
+      using Lanes = typename Program::FragmentLanes;
+      using Float = sl::float8;
+      using FIELDS = typename decltype(Program::varying.data)::FIELDS;
+
+      Program& prog;
+      SLOTS<U...> uniforms;
+      SLOTS<V...> varyings;
+      sl::vec<4,Float> color;
+      alignas(Lanes) char shader[sizeof(Lanes)] = {0};
+
+      QUAD(Program& prog) : prog(prog) {
+        auto f = (Lanes *)shader;
+        f->_ptr_gl_FragColor = &color;
+        bind_slots(f, uniforms.buf, LIST<U...>());
+        bind_slots(f, varyings.buf, LIST<V...>());
+        broadcast_slots(prog, uniforms.buf, LIST<U...>());
+      }
+
+      QUAD(QUAD const&) = delete;
+
+      // lane l at barycentrics P[l], divided by w, of the triangle with vertices
+      // i, lanes from sl::QUAD_LANES on at P[0]; the color of lane 0
+      sl::vec<4,float>
+      run(typename Program::vec3 const P[sl::QUAD_LANES], size_t const i[3]) {
+        sl::vec<3,Float> B;
+        for(size_t l=0; l<Float::LANES; l++)
+          insert_lane(B, P[(l < sl::QUAD_LANES) ? l : 0], l);
+
+        char *p = varyings.buf;
+        auto f [[ gnu::unused ]] = [&](size_t size, auto *x, auto *s, auto *a, auto *b, auto *c) {
+          using S = ::std::remove_pointer_t<decltype(s)>;
+          ::std::remove_pointer_t<decltype(x)> v[3];
+          broadcast(v[0], S(*a));
+          broadcast(v[1], S(*b));
+          broadcast(v[2], S(*c));
+          *x = sl::interpolate(B, v[0], v[1], v[2]);
+          p += size;
+        };
+
+        (f(SLOTS<V...>::SLOT(sizeof(typename V::TYPE)),
+           (typename V::TYPE *)p,
+           (LOOKUP_T<typename V::NAME, FIELDS> *)nullptr,
+           prog.varying.data.template at<typename V::NAME>(i[0]),
+           prog.varying.data.template at<typename V::NAME>(i[1]),
+           prog.varying.data.template at<typename V::NAME>(i[2])),...);
+        ((Lanes *)shader)->main();
+
+        sl::vec<4,float> r;
+        extract_lane(r, color, 0);
+        return r;
+      }
+    };
+
+    template<typename T, typename L>
+    constexpr
+    bool HAS_TYPE = false;
+
+    template<typename T, typename... M>
+    constexpr
+    bool HAS_TYPE<T, LIST<M...>> = (false || ... || ::std::is_same<typename M::TYPE, T>::value);
+
+    // the precision of a shader, its optional second template argument
+    template<typename S>
+    struct PRECISION {
+      static constexpr bool FAST = false;
+    };
+
+    template<template<typename...> typename S, typename T, typename P>
+    struct PRECISION<S<T,P>> {
+      static constexpr bool FAST = ::std::is_same<P, sl::precision_fast>::value;
+    };
+
+    // shaders only linked at highp need not take a precision
+    template<template<typename...> typename S, typename T, typename P>
+    struct QUALIFY {
+      using TYPE = S<T,P>;
+    };
+
+    template<template<typename...> typename S, typename T>
+    struct QUALIFY<S, T, sl::precision_highp> {
+      using TYPE = S<T>;
+    };
+
+    template<typename T, template<typename...> typename V, template<typename...> typename F, typename Precision = sl::precision_highp, typename Varying = storage_native, typename Shading = vertex_scalar>
     struct Link {
       using Float = T;
-      using Vertex = V<T>;
-      using Fragment = F<T>;
+      using Raster = typename sl::WIDEN<T>::TYPE;
+      using Vertex = typename QUALIFY<V,T,Precision>::TYPE;
+      using Fragment = typename QUALIFY<F,T,Precision>::TYPE;
 
       using vec2 = ::gl::sl::vec<2,T>;
       using vec3 = ::gl::sl::vec<3,T>;
@@ -307,28 +776,51 @@ namespace gl {
       using mat3 = ::gl::sl::mat<3,T>;
       using mat4 = ::gl::sl::mat<4,T>;
 
+      // vertices shaded per run of the vertex shader
+      static constexpr size_t LANES = ::std::is_same<Shading, vertex_simd>::value ? sl::float8::LANES : 1;
+      using VertexLanes = typename QUALIFY<V, ::std::conditional_t<(LANES > 1), sl::float8, T>, Precision>::TYPE;
+
+      static_assert(LANES == 1 || (::std::is_same<T, float>::value && ::std::is_same<Precision, sl::precision_highp>::value),
+                    "vertex_simd needs float highp programs");
+
+      // float programs whose fragment shader samples textures shade its float8
+      // instance for texture2D's level of detail; others sample level 0
+      static constexpr bool DERIVATIVES = HAS_TYPE<sl::sampler2D, MEMBERS<T_uniform, Fragment>> && ::std::is_same<T, float>::value;
+      using FragmentLanes = typename QUALIFY<F, ::std::conditional_t<DERIVATIVES, sl::float8, T>, Precision>::TYPE;
+
       BINDING<
         MAKE_PAIR_LIST<MEMBERS<T_uniform, Vertex>, MEMBERS<T_uniform, Fragment>>,
+        storage_native,
         PAIR<Vertex, MEMBERS<T_uniform, Vertex>>,
         PAIR<Fragment, MEMBERS<T_uniform, Fragment>>
         > uniform;
 
       BINDING<
         MAKE_PAIR_LIST<MEMBERS<T_attribute, Vertex>>,
+        storage_native,
         PAIR<Vertex, MEMBERS<T_attribute, Vertex>>
         > attribute;
 
       BINDING<
         ENSURE_DEFINED<MAKE_PAIR_LIST<MEMBERS<T_varying, Vertex>>, MEMBERS<T_varying, Fragment>>,
+        Varying,
         PAIR<Vertex, MEMBERS<T_varying, Vertex>>,
         PAIR<Fragment, MEMBERS<T_varying, Fragment>>
         > varying;
 
+      // transform feedback: when set, the vertex shader's varyings are also
+      // written here, indexed by source vertex, before perspective division
+      BINDING<
+        MAKE_PAIR_LIST<MEMBERS<T_varying, Vertex>>,
+        storage_native,
+        PAIR<Vertex, MEMBERS<T_varying, Vertex>>
+        > feedback = {};
+
       size_t vertices;
-      vec4 *gl_Position;
+      ::gl::sl::vec<4,Raster> *gl_Position;
 
       Link(size_t n) : vertices(n) {
-        gl_Position = (vec4 *)::std::malloc(sizeof(vec4) * n);
+        gl_Position = (::gl::sl::vec<4,Raster> *)::std::malloc(sizeof(::gl::sl::vec<4,Raster>) * n);
         varying.data.alloc(n);
       }
 
@@ -337,6 +829,65 @@ namespace gl {
         free(gl_Position);
       }
 
+      template<typename L=MEMBERS<T_varying, Vertex>>
+      inline
+      auto
+      output(Vertex *v, size_t n) {
+        return output(v, n, L());
+      }
+
+      template<typename... U>
+      inline
+      auto
+      output(Vertex *v, size_t n, LIST<U...>) {
+        return OUTPUT<Link, U...>(varying.data, v, n);
+      }
+
+      // the state shared by the runs of one draw; nothing for scalar programs
+      auto
+      group() {
+        if constexpr (LANES > 1)
+          return group(MEMBERS<T_uniform, VertexLanes>(), MEMBERS<T_attribute, VertexLanes>(), MEMBERS<T_varying, VertexLanes>());
+        else
+          return nullptr;
+      }
+
+      template<typename... U, typename... A, typename... W>
+      auto
+      group(LIST<U...>, LIST<A...>, LIST<W...>) {
+        return GROUP<Link, LIST<U...>, LIST<A...>, LIST<W...>>(*this);
+      }
+
+      // the state shared by the fragments of one draw; nothing without DERIVATIVES
+      auto
+      quad() {
+        if constexpr (DERIVATIVES)
+          return quad(MEMBERS<T_uniform, FragmentLanes>(), MEMBERS<T_varying, FragmentLanes>());
+        else
+          return nullptr;
+      }
+
+      template<typename... U, typename... W>
+      auto
+      quad(LIST<U...>, LIST<W...>) {
+        return QUAD<Link, LIST<U...>, LIST<W...>>(*this);
+      }
+
+      template<typename L=MEMBERS<T_varying, Vertex>>
+      inline
+      void
+      capture(Vertex *v, size_t n) {
+        capture(v, n, L());
+      }
+
+      template<typename... U>
+      inline
+      void
+      capture(Vertex *v [[ gnu::unused ]], size_t n [[ gnu::unused ]], LIST<U...>) {
+        auto f [[ gnu::unused ]] = [n](auto *p, auto *x){ if (p) p[n] = *x; };
+        (f(feedback.get(typename U::NAME()), v->*(U::POINTER)),...);
+      }
+
       template<typename L=MEMBERS<T_varying, Vertex>>
       static
       inline
@@ -371,6 +922,12 @@ namespace gl {
   }
 
   using shader::Link;
+  using shader::storage_native;
+  using shader::storage_half;
+  using shader::vertex_scalar;
+  using shader::vertex_simd;
+  using shader::hash_bytes;
+  }
 }
 
 template <typename T, T... chars>
@@ -397,18 +954,50 @@ operator""_s() {
 #define ATTRIBUTE(v, ...) _VAR(::gl::shader::T_attribute, v, __VA_ARGS__)
 #define VARYING(v, ...) _VAR(::gl::shader::T_varying, v, __VA_ARGS__)
 
+#define FIELD(v, ...)                                   \
+  __VA_ARGS__ v;                                        \
+  static_assert(                                        \
+                ::gl::shader::declare<                  \
+                ::gl::shader::T_field, __CLASS__,       \
+                decltype(#v##_s),                       \
+                __VA_ARGS__,                            \
+                &__CLASS__::v>())
+
+
+#define _MATH(f)                                                        \
+  template<typename... A>                                               \
+  static auto                                                           \
+  f(A const&... a) {                                                    \
+    if constexpr (__PRECISION__::FAST)                                  \
+      return ::gl::sl::fast::f(a...);                                   \
+    else                                                                \
+      return ::gl::sl::f(a...);                                         \
+  }
+
+#define _TYPES(F)                                                       \
+  using Float = F;                                                      \
+  using vec2 = ::gl::sl::vec<2,Float>;                                  \
+  using vec3 = ::gl::sl::vec<3,Float>;                                  \
+  using vec4 = ::gl::sl::vec<4,Float>;                                  \
+  using mat2 = ::gl::sl::mat<2,Float>;                                  \
+  using mat3 = ::gl::sl::mat<3,Float>;                                  \
+  using mat4 = ::gl::sl::mat<4,Float>;                                  \
+  using sampler2D = ::gl::sl::sampler2D
+
+#define _PRECISION(F)                                                   \
+  using __PRECISION__ = ::gl::shader::PRECISION<__CLASS__>;             \
+  _MATH(sin) _MATH(cos) _MATH(tan)                                      \
+  _MATH(exp) _MATH(exp2) _MATH(log) _MATH(log2) _MATH(pow)              \
+  _MATH(sqrt) _MATH(inversesqrt) _MATH(length) _MATH(normalize)         \
+  _TYPES(F)
+
 
 #define VERTEX_SHADER(T,F)                                              \
   using __CLASS__ = T;                                                  \
   static_assert(::gl::shader::enable<::gl::shader::T_uniform,T>());     \
   static_assert(::gl::shader::enable<::gl::shader::T_attribute,T>());   \
   static_assert(::gl::shader::enable<::gl::shader::T_varying,T>());     \
-  using vec2 = ::gl::sl::vec<2,F>;                                      \
-  using vec3 = ::gl::sl::vec<3,F>;                                      \
-  using vec4 = ::gl::sl::vec<4,F>;                                      \
-  using mat2 = ::gl::sl::mat<2,F>;                                      \
-  using mat3 = ::gl::sl::mat<3,F>;                                      \
-  using mat4 = ::gl::sl::mat<4,F>;                                      \
+  _PRECISION(F);                                                        \
   union {                                                               \
     struct {                                                            \
       vec4& gl_Position;                                                \
@@ -420,15 +1009,15 @@ operator""_s() {
   using __CLASS__ = T;                                                  \
   static_assert(::gl::shader::enable<::gl::shader::T_uniform,T>());     \
   static_assert(::gl::shader::enable<::gl::shader::T_varying,T>());     \
-  using vec2 = ::gl::sl::vec<2,F>;                                      \
-  using vec3 = ::gl::sl::vec<3,F>;                                      \
-  using vec4 = ::gl::sl::vec<4,F>;                                      \
-  using mat2 = ::gl::sl::mat<2,F>;                                      \
-  using mat3 = ::gl::sl::mat<3,F>;                                      \
-  using mat4 = ::gl::sl::mat<4,F>;                                      \
+  _PRECISION(F);                                                        \
   union {                                                               \
     struct {                                                            \
       vec4& gl_FragColor;                                               \
     };                                                                  \
     vec4* _ptr_gl_FragColor;                                            \
   }
+
+#define UNIFORM_BLOCK(T,F)                                              \
+  using __CLASS__ = T;                                                  \
+  static_assert(::gl::shader::enable<::gl::shader::T_field,T>());       \
+  _TYPES(F)
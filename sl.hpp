@@ -3,15 +3,72 @@
 #include <cmath>
 #include <algorithm>
 #include <type_traits>
+#include <utility>
+#include "scalar.hpp"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
 
 namespace gl {
+  inline namespace GL_ISA {
   namespace sl {
     using ::std::size_t;
 
+    template<size_t N, typename T>
+    constexpr
+    bool packed = false;
+
+#ifdef __SSE2__
+    template<>
+    constexpr
+    bool packed<3,float> = true;
+
+    template<>
+    constexpr
+    bool packed<4,float> = true;
+#endif
+
+    template<size_t N, typename T>
+    using if_packed = ::std::enable_if_t<packed<N,T>>;
+
+    constexpr
+    bool
+    constant_evaluated() {
+      return __builtin_is_constant_evaluated();
+    }
+
+    template<size_t N, typename T, typename E>
+    struct expr {
+      static constexpr size_t SIZE = N;
+      using SCALAR = T;
+
+      constexpr E const& self() const { return static_cast<E const&>(*this); }
+    };
+
+    template<size_t N, typename T, typename E>
+    struct mexpr {
+      static constexpr size_t SIZE = N;
+      using SCALAR = T;
+
+      constexpr E const& self() const { return static_cast<E const&>(*this); }
+    };
+
     template<size_t N, typename T> struct vec;
 
+    template<size_t N, typename T, typename E>
+    constexpr
+    void
+    assign(vec<N,T>& r, E const& e);
+
     template<typename T>
-    struct vec<2,T> {
+    struct vec<2,T> : expr<2,T,vec<2,T>> {
+      static constexpr bool PACKET = false;
+
       union {
         T data[2];
         struct {T x, y;};
@@ -19,444 +76,969 @@ namespace gl {
         struct {T s, t;};
       };
 
-      T& operator[](size_t n) { return data[n]; }
-      T const& operator[](size_t n) const { return data[n]; }
+      constexpr T& operator[](size_t n) { return data[n]; }
+      constexpr T const& operator[](size_t n) const { return data[n]; }
 
-      vec() { }
-      vec(T v) : data {v, v} { }
-      vec(T v0, T v1) : data {v0, v1} { }
-      vec(vec<3,T> const& v) : data {v[0], v[1]} { }
-      vec(vec<4,T> const& v) : data {v[0], v[1]} { }
+      constexpr vec() : data {} { }
+      constexpr vec(T v) : data {v, v} { }
+      constexpr vec(T v0, T v1) : data {v0, v1} { }
+      constexpr vec(vec<3,T> const& v) : data {v[0], v[1]} { }
+      constexpr vec(vec<4,T> const& v) : data {v[0], v[1]} { }
 
       template<typename U>
-      vec(vec<2,U> const& v) : data {T(v[0]), T(v[1])} {}
+      constexpr vec(vec<2,U> const& v) : data {T(v[0]), T(v[1])} {}
+
+      template<typename E>
+      constexpr vec(expr<2,T,E> const& e) : data {} { assign(*this, e.self()); }
+
+      template<typename E>
+      constexpr vec& operator=(expr<2,T,E> const& e) { assign(*this, e.self()); return *this; }
     };
 
 
     template<typename T>
-    struct vec<3,T> {
+    struct vec<3,T> : expr<3,T,vec<3,T>> {
+      static constexpr bool PACKET = packed<3,T>;
+
       union {
-        T data[3];
+        alignas(packed<3,T> ? 16 : alignof(T)) T data[packed<3,T> ? 4 : 3];
         struct {T x, y, z;};
         struct {T r, g, b;};
         struct {T s, t, p;};
       };
 
-      T& operator[](size_t n) { return data[n]; }
-      T const& operator[](size_t n) const { return data[n]; }
+      constexpr T& operator[](size_t n) { return data[n]; }
+      constexpr T const& operator[](size_t n) const { return data[n]; }
 
-      vec() { }
-      vec(T v) : data {v, v, v} { }
-      vec(T v0, T v1, T v2) : data {v0, v1, v2} { }
-      vec(vec<2,T> const& u, T v) : data {u[0], u[1], v} { }
-      vec(T u, vec<2,T> const& v) : data {u, v[0], v[1]} { }
-      vec(vec<4,T> const& v) : data {v[0], v[1], v[2]} { }
+#ifdef __SSE2__
+      __m128 packet() const { return _mm_load_ps(data); }
+#endif
+
+      constexpr vec() : data {} { }
+      constexpr vec(T v) : data {v, v, v} { }
+      constexpr vec(T v0, T v1, T v2) : data {v0, v1, v2} { }
+      constexpr vec(vec<2,T> const& u, T v) : data {u[0], u[1], v} { }
+      constexpr vec(T u, vec<2,T> const& v) : data {u, v[0], v[1]} { }
+      constexpr vec(vec<4,T> const& v) : data {v[0], v[1], v[2]} { }
 
       template<typename U>
-      vec(vec<3,U> const& v) : data {T(v[0]), T(v[1]), T(v[2])} {}
+      constexpr vec(vec<3,U> const& v) : data {T(v[0]), T(v[1]), T(v[2])} {}
+
+      template<typename E>
+      constexpr vec(expr<3,T,E> const& e) : data {} { assign(*this, e.self()); }
+
+      template<typename E>
+      constexpr vec& operator=(expr<3,T,E> const& e) { assign(*this, e.self()); return *this; }
     };
 
 
     template<typename T>
-    struct vec<4,T> {
+    struct vec<4,T> : expr<4,T,vec<4,T>> {
+      static constexpr bool PACKET = packed<4,T>;
+
       union {
-        T data[4];
+        alignas(packed<4,T> ? 16 : alignof(T)) T data[4];
         struct {T x, y, z, w;};
         struct {T r, g, b, a;};
         struct {T s, t, p, q;};
       };
 
-      T& operator[](size_t n) { return data[n]; }
-      T const& operator[](size_t n) const { return data[n]; }
+      constexpr T& operator[](size_t n) { return data[n]; }
+      constexpr T const& operator[](size_t n) const { return data[n]; }
+
+#ifdef __SSE2__
+      __m128 packet() const { return _mm_load_ps(data); }
+#endif
 
-      vec() { }
-      vec(T v) : data {v, v, v, v} { }
-      vec(T v0, T v1, T v2, T v3) : data {v0, v1, v2, v3} {  }
-      vec(vec<3,T> const& u, T v) : data {u[0], u[1], u[2], v} { }
-      vec(T u, vec<3,T> const& v) : data {u, v[0], v[1], v[2]} { }
-      vec(vec<2,T> const& u, vec<2,T> const& v) : data {u[0], u[1], v[0], v[1]} { }
-      vec(vec<2,T> const& u, T v, T w) : data {u[0], u[1], v, w} { }
-      vec(T u, vec<2,T> const& v, T w) : data {u, v[0], v[1], w} { }
-      vec(T u, T v, vec<2,T> const& w) : data {u, v, w[0], w[1]} { }
+      constexpr vec() : data {} { }
+      constexpr vec(T v) : data {v, v, v, v} { }
+      constexpr vec(T v0, T v1, T v2, T v3) : data {v0, v1, v2, v3} { }
+      constexpr vec(vec<3,T> const& u, T v) : data {u[0], u[1], u[2], v} { }
+      constexpr vec(T u, vec<3,T> const& v) : data {u, v[0], v[1], v[2]} { }
+      constexpr vec(vec<2,T> const& u, vec<2,T> const& v) : data {u[0], u[1], v[0], v[1]} { }
+      constexpr vec(vec<2,T> const& u, T v, T w) : data {u[0], u[1], v, w} { }
+      constexpr vec(T u, vec<2,T> const& v, T w) : data {u, v[0], v[1], w} { }
+      constexpr vec(T u, T v, vec<2,T> const& w) : data {u, v, w[0], w[1]} { }
 
       template<typename U>
-      vec(vec<4,U> const& v) : data {T(v[0]), T(v[1]), T(v[2]), T(v[3])} {}
+      constexpr vec(vec<4,U> const& v) : data {T(v[0]), T(v[1]), T(v[2]), T(v[3])} {}
+
+      template<typename E>
+      constexpr vec(expr<4,T,E> const& e) : data {} { assign(*this, e.self()); }
+
+      template<typename E>
+      constexpr vec& operator=(expr<4,T,E> const& e) { assign(*this, e.self()); return *this; }
     };
 
     template<size_t N, typename T> struct mat;
 
     template<typename T>
-    struct mat<2,T>{
+    struct mat<2,T> : mexpr<2,T,mat<2,T>> {
       vec<2,T> data[2];
 
-      vec<2,T>& operator[](size_t n) { return data[n]; }
-      vec<2,T> const& operator[](size_t n) const { return data[n]; }
+      constexpr vec<2,T>& operator[](size_t n) { return data[n]; }
+      constexpr vec<2,T> const& operator[](size_t n) const { return data[n]; }
+
+      constexpr mat() { }
+      constexpr mat(T const& v) : mat(v, v) { }
+      constexpr mat(vec<2,T> const& v0, vec<2,T> const& v1) : data {v0, v1} { }
 
-      mat() { }
-      mat(T const& v) : mat(v, v) { }
-      mat(vec<2,T> const& v0, vec<2,T> const& v1) : data {v0, v1} { }
+      template<typename U>
+      constexpr mat(mat<2,U> const& m) : data {m[0], m[1]} { }
+
+      template<typename E>
+      constexpr mat(mexpr<2,T,E> const& e) : data {e.self()[0], e.self()[1]} { }
     };
 
     template<typename T>
-    struct mat<3,T>{
+    struct mat<3,T> : mexpr<3,T,mat<3,T>> {
       vec<3,T> data[3];
 
-      vec<3,T>& operator[](size_t n) { return data[n]; }
-      vec<3,T> const& operator[](size_t n) const { return data[n]; }
+      constexpr vec<3,T>& operator[](size_t n) { return data[n]; }
+      constexpr vec<3,T> const& operator[](size_t n) const { return data[n]; }
+
+      constexpr mat() { }
+      constexpr mat(T const& v) : mat(v, v, v) { }
+      constexpr mat(vec<3,T> const& v0, vec<3,T> const& v1, vec<3,T> const& v2) : data {v0, v1, v2} { }
 
-      mat() { }
-      mat(T const& v) : mat(v, v, v) { }
-      mat(vec<3,T> const& v0, vec<3,T> const& v1, vec<3,T> const& v2) : data {v0, v1, v2} { }
+      template<typename U>
+      constexpr mat(mat<3,U> const& m) : data {m[0], m[1], m[2]} { }
+
+      template<typename E>
+      constexpr mat(mexpr<3,T,E> const& e) : data {e.self()[0], e.self()[1], e.self()[2]} { }
     };
 
     template<typename T>
-    struct mat<4,T>{
+    struct mat<4,T> : mexpr<4,T,mat<4,T>> {
       vec<4,T> data[4];
 
-      vec<4,T>& operator[](size_t n) { return data[n]; }
-      vec<4,T> const& operator[](size_t n) const { return data[n]; }
+      constexpr vec<4,T>& operator[](size_t n) { return data[n]; }
+      constexpr vec<4,T> const& operator[](size_t n) const { return data[n]; }
+
+      constexpr mat() { }
+      constexpr mat(T const& v) : mat(v, v, v, v) { }
+      constexpr mat(vec<4,T> const& v0, vec<4,T> const& v1, vec<4,T> const& v2, vec<4,T> const& v3) : data {v0, v1, v2, v3} { }
 
-      mat() { }
-      mat(T const& v) : mat(v, v, v, v) { }
-      mat(vec<4,T> const& v0, vec<4,T> const& v1, vec<4,T> const& v2, vec<4,T> const& v3) : data {v0, v1, v2, v3} { }
+      template<typename U>
+      constexpr mat(mat<4,U> const& m) : data {m[0], m[1], m[2], m[3]} { }
+
+      template<typename E>
+      constexpr mat(mexpr<4,T,E> const& e) : data {e.self()[0], e.self()[1], e.self()[2], e.self()[3]} { }
     };
 
-    template<typename F, size_t N, typename T>
-    auto
-    map1(F const& f, vec<N,T> const& u) -> vec<N,decltype(f(u[0]))> {
-      using R = decltype(f(u[0]));
-      vec<N,R> r(0.0);
-      for(size_t i=0; i<N; i++)
-        r[i] = f(u[i]);
-      return r;
-    }
+    namespace op {
+      struct negate {
+        template<typename T> constexpr T operator()(T a) const { return -a; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a) const { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+#endif
+      };
 
-    template<typename F, size_t N, typename T>
-    auto
-    map1(F const& f, mat<N,T> const& u) -> mat<N,decltype(f(u[0][0]))> {
-      using R = decltype(f(u[0][0]));
-      mat<N,R> r(0.0);
-      for(size_t i=0; i<N; i++)
-        r[i] = map1(f, u[i]);
-      return r;
-    }
+      struct plus {
+        template<typename T> constexpr T operator()(T a, T b) const { return a + b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_add_ps(a, b); }
+#endif
+      };
 
-    template<typename F, size_t N, typename T>
-    auto
-    map2(F const& f, vec<N,T> const& u, vec<N,T> const& v) -> vec<N,decltype(f(u[0],v[0]))> {
-      using R = decltype(f(u[0],v[0]));
-      vec<N,R> r(0.0);
-      for(size_t i=0; i<N; i++)
-        r[i] = f(u[i], v[i]);
-      return r;
-    }
+      struct minus {
+        template<typename T> constexpr T operator()(T a, T b) const { return a - b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_sub_ps(a, b); }
+#endif
+      };
 
-    template<typename F, size_t N, typename T>
-    auto
-    map2(F const& f, mat<N,T> const& u, mat<N,T> const& v) -> mat<N,decltype(f(u[0][0],v[0][0]))> {
-      using R = decltype(f(u[0][0],v[0][0]));
-      mat<N,R> r(0.0);
-      for(size_t i=0; i<N; i++)
-        r[i] = map2(f, u[i], v[i]);
-      return r;
-    }
+      struct multiplies {
+        template<typename T> constexpr T operator()(T a, T b) const { return a * b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_mul_ps(a, b); }
+#endif
+      };
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator*(mat<N,T> const& u, mat<N,T> const& v) {
-      mat<N,T> r(0.0);
-      for(size_t i=0; i<N; i++)
-        for(size_t j=0; j<N; j++)
-          for(size_t k=0; k<N; k++)
-            r[i][k] += u[j][k] * v[i][j];
-      return r;
-    }
+      struct divides {
+        template<typename T> constexpr T operator()(T a, T b) const { return a / b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_div_ps(a, b); }
+#endif
+      };
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator*(mat<N,T> const& u, vec<N,T> const& v) {
-      vec<N,T> r(0.0);
-      for(size_t i=0; i<N; i++)
-        for(size_t j=0; j<N; j++)
-          r[j] += u[i][j] * v[i];
-      return r;
+      struct minimum {
+        template<typename T> constexpr T operator()(T a, T b) const { return ::std::min(a, b); }
+        float8 operator()(float8 const& a, float8 const& b) const { return min(a, b); }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_min_ps(b, a); }
+#endif
+      };
+
+      struct maximum {
+        template<typename T> constexpr T operator()(T a, T b) const { return ::std::max(a, b); }
+        float8 operator()(float8 const& a, float8 const& b) const { return max(a, b); }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_max_ps(b, a); }
+#endif
+      };
+
+      struct less {
+        template<typename T> constexpr bool operator()(T a, T b) const { return a < b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_cmplt_ps(a, b); }
+#endif
+      };
+
+      struct less_equal {
+        template<typename T> constexpr bool operator()(T a, T b) const { return a <= b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_cmple_ps(a, b); }
+#endif
+      };
+
+      struct greater {
+        template<typename T> constexpr bool operator()(T a, T b) const { return a > b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_cmpgt_ps(a, b); }
+#endif
+      };
+
+      struct greater_equal {
+        template<typename T> constexpr bool operator()(T a, T b) const { return a >= b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_cmpge_ps(a, b); }
+#endif
+      };
+
+      struct equal_to {
+        template<typename T> constexpr bool operator()(T a, T b) const { return a == b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_cmpeq_ps(a, b); }
+#endif
+      };
+
+      struct not_equal_to {
+        template<typename T> constexpr bool operator()(T a, T b) const { return a != b; }
+#ifdef __SSE2__
+        __m128 operator()(__m128 a, __m128 b) const { return _mm_cmpneq_ps(a, b); }
+#endif
+      };
     }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator*(vec<N,T> const& u, mat<N,T> const& v) {
-      vec<N,T> r(0.0);
+    template<typename F, typename = void>
+    constexpr
+    bool PACKET_OP = false;
+
+    template<typename F, typename = void>
+    constexpr
+    bool PACKET_UNARY_OP = false;
+
+#ifdef __SSE2__
+    template<typename F>
+    constexpr
+    bool PACKET_OP<F, decltype((void)::std::declval<F const&>()(_mm_setzero_ps(), _mm_setzero_ps()))> = true;
+
+    template<typename F>
+    constexpr
+    bool PACKET_UNARY_OP<F, decltype((void)::std::declval<F const&>()(_mm_setzero_ps()))> = true;
+
+    namespace simd {
+      template<size_t N, typename = if_packed<N,float>>
+      inline
+      vec<N,float>
+      store(__m128 m) {
+        vec<N,float> r;
+        _mm_store_ps(r.data, m);
+        return r;
+      }
+
+      template<size_t N>
+      inline
+      vec<N,bool>
+      mask(__m128 m) {
+        int bits = _mm_movemask_ps(m);
+        vec<N,bool> r;
+        for(size_t i=0; i<N; i++)
+          r[i] = (bits >> i) & 1;
+        return r;
+      }
+
+      inline
+      __m128
+      splat(__m128 m, int i) {
+        switch(i) {
+        case 0: return _mm_shuffle_ps(m, m, _MM_SHUFFLE(0,0,0,0));
+        case 1: return _mm_shuffle_ps(m, m, _MM_SHUFFLE(1,1,1,1));
+        case 2: return _mm_shuffle_ps(m, m, _MM_SHUFFLE(2,2,2,2));
+        default: return _mm_shuffle_ps(m, m, _MM_SHUFFLE(3,3,3,3));
+        }
+      }
+
+      inline
+      __m128
+      madd(__m128 a, __m128 b, __m128 c) {
+#ifdef __FMA__
+        return _mm_fmadd_ps(a, b, c);
+#else
+        return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+      }
+
+      template<size_t N>
+      inline
+      float
+      dot(__m128 a, __m128 b) {
+        __m128 m = _mm_mul_ps(a, b);
+        if (N == 3)
+          m = _mm_and_ps(m, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+        __m128 s = _mm_add_ps(m, _mm_movehl_ps(m, m));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1,1,1,1)));
+        return _mm_cvtss_f32(s);
+      }
+    }
+#endif
+
+    template<size_t N, typename T, typename E>
+    constexpr
+    void
+    assign(vec<N,T>& r, E const& e) {
+#ifdef __SSE2__
+      if constexpr (E::PACKET) {
+        if (!constant_evaluated()) {
+          _mm_store_ps(r.data, e.packet());
+          return;
+        }
+      }
+#endif
       for(size_t i=0; i<N; i++)
-        for(size_t j=0; j<N; j++)
-          r[i] += u[j] * v[i][j];
-      return r;
+        r.data[i] = e[i];
     }
 
     template<size_t N, typename T>
-    T
-    dot(vec<N,T> const& u, vec<N,T> const& v) {
-      T r(0.0);
-      for(size_t i=0; i<N; i++)
-        r += u[i]*v[i];
-      return r;
-    }
+    struct scalar : expr<N,T,scalar<N,T>> {
+      static constexpr bool PACKET = packed<N,T>;
+      T value;
 
-    template<typename T>
-    vec<3,T>
-    cross(vec<3,T> const& u, vec<3,T> const& v) {
-      return {
-        u.y * v.z - v.y * u.z,
-        u.z * v.x - v.z * u.x,
-        u.x * v.y - v.x * u.y };
-    }
+      constexpr scalar(T v) : value(v) { }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    matrixCompMult(mat<N,T> const& u, mat<N,T> const& v) {
-      return map2([](T a, T b){return a*b;}, u, v);
-    }
+      template<typename U, typename = ::std::enable_if_t<::std::is_arithmetic<U>::value>>
+      constexpr scalar(U v) : value(v) { }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator+(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a+b;}, u, v);
-    }
+      constexpr T operator[](size_t) const { return value; }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator+(T const& u, vec<N,T> const& v) {
-      return vec<N,T>(u) + v;
-    }
+#ifdef __SSE2__
+      __m128 packet() const { return _mm_set1_ps(value); }
+#endif
+    };
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator+(vec<N,T> const& u, T const& v) {
-      return u + vec<N,T>(v);
-    }
+    template<typename F, size_t N, typename T, typename E>
+    struct unary : expr<N,T,unary<F,N,T,E>> {
+      static constexpr bool PACKET = ::std::decay_t<E>::PACKET;
+      E e;
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator+(mat<N,T> const& u, mat<N,T> const& v) {
-      return map2([](T a, T b){return a+b;}, u, v);
-    }
+      constexpr unary(E u) : e(u) { }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator+(T const& u, mat<N,T> const& v) {
-      return mat<N,T>(u) + v;
-    }
+      constexpr T operator[](size_t i) const { return F()(T(e[i])); }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator+(mat<N,T> const& u, T const& v) {
-      return u + mat<N,T>(v);
-    }
+#ifdef __SSE2__
+      __m128 packet() const { return F()(e.packet()); }
+#endif
+    };
+
+    template<typename F, size_t N, typename T, typename L, typename R>
+    struct binary : expr<N,T,binary<F,N,T,L,R>> {
+      static constexpr bool PACKET = ::std::decay_t<L>::PACKET && ::std::decay_t<R>::PACKET;
+      L l;
+      R r;
+
+      constexpr binary(L u, R v) : l(u), r(v) { }
 
+      constexpr T operator[](size_t i) const { return F()(T(l[i]), T(r[i])); }
+
+#ifdef __SSE2__
+      __m128 packet() const { return F()(l.packet(), r.packet()); }
+#endif
+    };
+
+    template<typename M>
+    using COLUMN = decltype(::std::declval<M const&>()[0]);
 
     template<size_t N, typename T>
-    vec<N,T>
-    operator-(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a-b;}, u, v);
-    }
+    struct mscalar : mexpr<N,T,mscalar<N,T>> {
+      T value;
+
+      constexpr mscalar(T v) : value(v) { }
+
+      template<typename U, typename = ::std::enable_if_t<::std::is_arithmetic<U>::value>>
+      constexpr mscalar(U v) : value(v) { }
+
+      constexpr scalar<N,T> operator[](size_t) const { return value; }
+    };
+
+    template<typename F, size_t N, typename T, typename E>
+    struct munary : mexpr<N,T,munary<F,N,T,E>> {
+      E e;
+
+      constexpr munary(E u) : e(u) { }
+
+      constexpr unary<F,N,T,COLUMN<E>> operator[](size_t i) const { return e[i]; }
+    };
+
+    template<typename F, size_t N, typename T, typename L, typename R>
+    struct mbinary : mexpr<N,T,mbinary<F,N,T,L,R>> {
+      L l;
+      R r;
+
+      constexpr mbinary(L u, R v) : l(u), r(v) { }
+
+      constexpr binary<F,N,T,COLUMN<L>,COLUMN<R>> operator[](size_t i) const { return {l[i], r[i]}; }
+    };
+
+    template<size_t N, typename T, typename E>
+    ::std::integral_constant<int,1> KIND_OF(expr<N,T,E> const *);
+
+    template<size_t N, typename T, typename E>
+    ::std::integral_constant<int,2> KIND_OF(mexpr<N,T,E> const *);
+
+    ::std::integral_constant<int,0> KIND_OF(void const *);
+
+    template<typename E>
+    constexpr
+    int KIND = decltype(KIND_OF((::std::decay_t<E> const *)nullptr))::value;
+
+    template<typename E>
+    constexpr
+    bool LEAF = false;
 
     template<size_t N, typename T>
-    vec<N,T>
-    operator-(T const& u, vec<N,T> const& v) {
-      return vec<N,T>(u) - v;
-    }
+    constexpr
+    bool LEAF<vec<N,T>> = true;
 
     template<size_t N, typename T>
-    vec<N,T>
-    operator-(vec<N,T> const& u, T const& v) {
-      return u - vec<N,T>(v);
+    constexpr
+    bool LEAF<mat<N,T>> = true;
+
+    template<typename E>
+    using HOLD = ::std::conditional_t<::std::is_lvalue_reference<E>::value && LEAF<::std::decay_t<E>>,
+                                      ::std::decay_t<E> const&,
+                                      ::std::decay_t<E>>;
+
+    template<typename L, typename R>
+    constexpr
+    bool SAME_SHAPE = (::std::decay_t<L>::SIZE == ::std::decay_t<R>::SIZE) &&
+      ::std::is_same<typename ::std::decay_t<L>::SCALAR, typename ::std::decay_t<R>::SCALAR>::value;
+
+    template<typename S, typename E>
+    constexpr
+    bool SCALAR_OF = ::std::is_same<::std::decay_t<S>, typename ::std::decay_t<E>::SCALAR>::value ||
+      (!::std::is_arithmetic<typename ::std::decay_t<E>::SCALAR>::value && ::std::is_arithmetic<::std::decay_t<S>>::value);
+
+    template<typename F, typename E, int = KIND<E>>
+    struct UNARY {};
+
+    template<typename F, typename E>
+    struct UNARY<F, E, 1> {
+      using TYPE = unary<F, ::std::decay_t<E>::SIZE, typename ::std::decay_t<E>::SCALAR, HOLD<E>>;
+    };
+
+    template<typename F, typename E>
+    struct UNARY<F, E, 2> {
+      using TYPE = munary<F, ::std::decay_t<E>::SIZE, typename ::std::decay_t<E>::SCALAR, HOLD<E>>;
+    };
+
+    template<typename F, typename L, typename R, int = KIND<L>, int = KIND<R>, typename = void>
+    struct BINARY {};
+
+    template<typename F, typename L, typename R>
+    struct BINARY<F, L, R, 1, 1, ::std::enable_if_t<SAME_SHAPE<L,R>>> {
+      using TYPE = binary<F, ::std::decay_t<L>::SIZE, typename ::std::decay_t<L>::SCALAR, HOLD<L>, HOLD<R>>;
+    };
+
+    template<typename F, typename L, typename R>
+    struct BINARY<F, L, R, 1, 0, ::std::enable_if_t<SCALAR_OF<R,L>>> {
+      using TYPE = binary<F, ::std::decay_t<L>::SIZE, typename ::std::decay_t<L>::SCALAR, HOLD<L>, scalar<::std::decay_t<L>::SIZE, typename ::std::decay_t<L>::SCALAR>>;
+    };
+
+    template<typename F, typename L, typename R>
+    struct BINARY<F, L, R, 0, 1, ::std::enable_if_t<SCALAR_OF<L,R>>> {
+      using TYPE = binary<F, ::std::decay_t<R>::SIZE, typename ::std::decay_t<R>::SCALAR, scalar<::std::decay_t<R>::SIZE, typename ::std::decay_t<R>::SCALAR>, HOLD<R>>;
+    };
+
+    template<typename F, typename L, typename R>
+    struct BINARY<F, L, R, 2, 2, ::std::enable_if_t<SAME_SHAPE<L,R> && !::std::is_same<F, op::multiplies>::value>> {
+      using TYPE = mbinary<F, ::std::decay_t<L>::SIZE, typename ::std::decay_t<L>::SCALAR, HOLD<L>, HOLD<R>>;
+    };
+
+    template<typename F, typename L, typename R>
+    struct BINARY<F, L, R, 2, 0, ::std::enable_if_t<SCALAR_OF<R,L>>> {
+      using TYPE = mbinary<F, ::std::decay_t<L>::SIZE, typename ::std::decay_t<L>::SCALAR, HOLD<L>, mscalar<::std::decay_t<L>::SIZE, typename ::std::decay_t<L>::SCALAR>>;
+    };
+
+    template<typename F, typename L, typename R>
+    struct BINARY<F, L, R, 0, 2, ::std::enable_if_t<SCALAR_OF<L,R>>> {
+      using TYPE = mbinary<F, ::std::decay_t<R>::SIZE, typename ::std::decay_t<R>::SCALAR, mscalar<::std::decay_t<R>::SIZE, typename ::std::decay_t<R>::SCALAR>, HOLD<R>>;
+    };
+
+    template<typename E>
+    constexpr
+    auto
+    operator-(E&& u) -> typename UNARY<op::negate, E>::TYPE {
+      return {::std::forward<E>(u)};
     }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator-(mat<N,T> const& u, mat<N,T> const& v) {
-      return map2([](T a, T b){return a-b;}, u, v);
+    template<typename L, typename R>
+    constexpr
+    auto
+    operator+(L&& u, R&& v) -> typename BINARY<op::plus, L, R>::TYPE {
+      return {::std::forward<L>(u), ::std::forward<R>(v)};
     }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator-(T const& u, mat<N,T> const& v) {
-      return mat<N,T>(u) - v;
+    template<typename L, typename R>
+    constexpr
+    auto
+    operator-(L&& u, R&& v) -> typename BINARY<op::minus, L, R>::TYPE {
+      return {::std::forward<L>(u), ::std::forward<R>(v)};
     }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator-(mat<N,T> const& u, T const& v) {
-      return u - mat<N,T>(v);
+    template<typename L, typename R>
+    constexpr
+    auto
+    operator*(L&& u, R&& v) -> typename BINARY<op::multiplies, L, R>::TYPE {
+      return {::std::forward<L>(u), ::std::forward<R>(v)};
     }
 
+    template<typename L, typename R>
+    constexpr
+    auto
+    operator/(L&& u, R&& v) -> typename BINARY<op::divides, L, R>::TYPE {
+      return {::std::forward<L>(u), ::std::forward<R>(v)};
+    }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator*(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a*b;}, u, v);
+    template<typename F, size_t N, typename T, typename E>
+    constexpr
+    auto
+    map1(F const& f, expr<N,T,E> const& u) -> vec<N,decltype(f(T()))> {
+      E const& e = u.self();
+#ifdef __SSE2__
+      if constexpr (E::PACKET && PACKET_UNARY_OP<F>) {
+        if (!constant_evaluated())
+          return simd::store<N>(f(e.packet()));
+      }
+#endif
+      vec<N,decltype(f(T()))> r;
+      for(size_t i=0; i<N; i++)
+        r[i] = f(e[i]);
+      return r;
     }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator*(T const& u, vec<N,T> const& v) {
-      return vec<N,T>(u) * v;
+    template<typename F, size_t N, typename T, typename E>
+    constexpr
+    auto
+    map1(F const& f, mexpr<N,T,E> const& u) -> mat<N,decltype(f(T()))> {
+      E const& e = u.self();
+      mat<N,decltype(f(T()))> r;
+      for(size_t i=0; i<N; i++)
+        r[i] = map1(f, e[i]);
+      return r;
     }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator*(vec<N,T> const& u, T const& v) {
-      return u * vec<N,T>(v);
+    template<typename F, size_t N, typename T, typename L, typename R>
+    constexpr
+    auto
+    map2(F const& f, expr<N,T,L> const& u, expr<N,T,R> const& v) -> vec<N,decltype(f(T(),T()))> {
+      using S = decltype(f(T(),T()));
+      L const& a = u.self();
+      R const& b = v.self();
+#ifdef __SSE2__
+      if constexpr (L::PACKET && R::PACKET && PACKET_OP<F>) {
+        if (!constant_evaluated()) {
+          if constexpr (::std::is_same<S,bool>::value)
+            return simd::mask<N>(f(a.packet(), b.packet()));
+          else
+            return simd::store<N>(f(a.packet(), b.packet()));
+        }
+      }
+#endif
+      vec<N,S> r;
+      for(size_t i=0; i<N; i++)
+        r[i] = f(a[i], b[i]);
+      return r;
     }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator*(T const& u, mat<N,T> const& v) {
-      return matrixCompMult(mat<N,T>(u), v);
+    template<typename F, size_t N, typename T, typename L, typename R>
+    constexpr
+    auto
+    map2(F const& f, mexpr<N,T,L> const& u, mexpr<N,T,R> const& v) -> mat<N,decltype(f(T(),T()))> {
+      L const& a = u.self();
+      R const& b = v.self();
+      mat<N,decltype(f(T(),T()))> r;
+      for(size_t i=0; i<N; i++)
+        r[i] = map2(f, a[i], b[i]);
+      return r;
     }
 
-    template<size_t N, typename T>
+#ifdef __SSE2__
+    namespace simd {
+      inline
+      vec<4,float>
+      product(mat<4,float> const& u, vec<4,float> const& v) {
+        __m128 m = v.packet();
+        __m128 r = _mm_mul_ps(u[0].packet(), splat(m, 0));
+        r = madd(u[1].packet(), splat(m, 1), r);
+        r = madd(u[2].packet(), splat(m, 2), r);
+        r = madd(u[3].packet(), splat(m, 3), r);
+        return store<4>(r);
+      }
+
+      inline
+      vec<4,float>
+      product(vec<4,float> const& u, mat<4,float> const& v) {
+        __m128 m = u.packet();
+        return {
+          dot<4>(m, v[0].packet()),
+          dot<4>(m, v[1].packet()),
+          dot<4>(m, v[2].packet()),
+          dot<4>(m, v[3].packet())
+        };
+      }
+
+      inline
+      mat<4,float>
+      product(mat<4,float> const& u, mat<4,float> const& v) {
+        mat<4,float> r;
+#ifdef __AVX__
+        for(size_t i=0; i<4; i+=2) {
+          __m256 w = _mm256_loadu_ps(v[i].data);
+          __m256 c = _mm256_mul_ps(_mm256_broadcast_ps((__m128 const *)u[0].data), _mm256_permute_ps(w, _MM_SHUFFLE(0,0,0,0)));
+          __m256 t1 = _mm256_mul_ps(_mm256_broadcast_ps((__m128 const *)u[1].data), _mm256_permute_ps(w, _MM_SHUFFLE(1,1,1,1)));
+          __m256 t2 = _mm256_mul_ps(_mm256_broadcast_ps((__m128 const *)u[2].data), _mm256_permute_ps(w, _MM_SHUFFLE(2,2,2,2)));
+          __m256 t3 = _mm256_mul_ps(_mm256_broadcast_ps((__m128 const *)u[3].data), _mm256_permute_ps(w, _MM_SHUFFLE(3,3,3,3)));
+          _mm256_storeu_ps(r[i].data, _mm256_add_ps(_mm256_add_ps(c, t1), _mm256_add_ps(t2, t3)));
+        }
+#else
+        for(size_t i=0; i<4; i++)
+          r[i] = product(u, v[i]);
+#endif
+        return r;
+      }
+    }
+#endif
+
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     mat<N,T>
-    operator*(mat<N,T> const& u, T const& v) {
-      return matrixCompMult(u, mat<N,T>(v));
+    operator*(mexpr<N,T,L> const& u, mexpr<N,T,R> const& v) {
+#ifdef __SSE2__
+      if constexpr (packed<N,T> && N == 4) {
+        if (!constant_evaluated())
+          return simd::product(mat<N,T>(u), mat<N,T>(v));
+      }
+#endif
+      L const& a = u.self();
+      R const& b = v.self();
+      mat<N,T> r(0.0);
+      for(size_t i=0; i<N; i++)
+        for(size_t j=0; j<N; j++)
+          for(size_t k=0; k<N; k++)
+            r[i][k] += a[j][k] * b[i][j];
+      return r;
     }
 
-
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     vec<N,T>
-    operator/(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a/b;}, u, v);
+    operator*(mexpr<N,T,L> const& u, expr<N,T,R> const& v) {
+#ifdef __SSE2__
+      if constexpr (packed<N,T> && N == 4) {
+        if (!constant_evaluated())
+          return simd::product(mat<N,T>(u), vec<N,T>(v));
+      }
+#endif
+      L const& a = u.self();
+      R const& b = v.self();
+      vec<N,T> r(0.0);
+      for(size_t i=0; i<N; i++)
+        for(size_t j=0; j<N; j++)
+          r[j] += a[i][j] * b[i];
+      return r;
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     vec<N,T>
-    operator/(T const& u, vec<N,T> const& v) {
-      return vec<N,T>(u) / v;
+    operator*(expr<N,T,L> const& u, mexpr<N,T,R> const& v) {
+#ifdef __SSE2__
+      if constexpr (packed<N,T> && N == 4) {
+        if (!constant_evaluated())
+          return simd::product(vec<N,T>(u), mat<N,T>(v));
+      }
+#endif
+      L const& a = u.self();
+      R const& b = v.self();
+      vec<N,T> r(0.0);
+      for(size_t i=0; i<N; i++)
+        for(size_t j=0; j<N; j++)
+          r[i] += a[j] * b[i][j];
+      return r;
     }
 
-    template<size_t N, typename T>
-    vec<N,T>
-    operator/(vec<N,T> const& u, T const& v) {
-      return u / vec<N,T>(v);
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
+    T
+    dot(expr<N,T,L> const& u, expr<N,T,R> const& v) {
+      L const& a = u.self();
+      R const& b = v.self();
+#ifdef __SSE2__
+      if constexpr (L::PACKET && R::PACKET) {
+        if (!constant_evaluated())
+          return simd::dot<N>(a.packet(), b.packet());
+      }
+#endif
+      T r(0.0);
+      for(size_t i=0; i<N; i++)
+        r += a[i]*b[i];
+      return r;
     }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator/(mat<N,T> const& u, mat<N,T> const& v) {
-      return map2([](T a, T b){return a/b;}, u, v);
+    template<typename T, typename L, typename R>
+    constexpr
+    vec<3,T>
+    cross(expr<3,T,L> const& u, expr<3,T,R> const& v) {
+      L const& a = u.self();
+      R const& b = v.self();
+#ifdef __SSE2__
+      if constexpr (L::PACKET && R::PACKET) {
+        if (!constant_evaluated()) {
+          __m128 p = a.packet();
+          __m128 q = b.packet();
+          __m128 c = _mm_sub_ps(_mm_mul_ps(p, _mm_shuffle_ps(q, q, _MM_SHUFFLE(3,0,2,1))),
+                                _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3,0,2,1)), q));
+          return simd::store<3>(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3,0,2,1)));
+        }
+      }
+#endif
+      return {
+        a[1] * b[2] - b[1] * a[2],
+        a[2] * b[0] - b[2] * a[0],
+        a[0] * b[1] - b[0] * a[1] };
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     mat<N,T>
-    operator/(T const& u, mat<N,T> const& v) {
-      return mat<N,T>(u) / v;
+    matrixCompMult(mexpr<N,T,L> const& u, mexpr<N,T,R> const& v) {
+      return map2(op::multiplies(), u, v);
     }
 
-    template<size_t N, typename T>
-    mat<N,T>
-    operator/(mat<N,T> const& u, T const& v) {
-      return u / mat<N,T>(v);
-    }
+    template<typename T>
+    struct NONDEDUCED {
+      using TYPE = T;
+    };
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N, bool>
-    lessThan(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a<b;}, u, v);
+    lessThan(expr<N,T,E> const& u, typename NONDEDUCED<vec<N,T>>::TYPE const& v) {
+      return map2(op::less(), u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N, bool>
-    lessThanEqual(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a<=b;}, u, v);
+    lessThanEqual(expr<N,T,E> const& u, typename NONDEDUCED<vec<N,T>>::TYPE const& v) {
+      return map2(op::less_equal(), u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N, bool>
-    greaterThan(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a>b;}, u, v);
+    greaterThan(expr<N,T,E> const& u, typename NONDEDUCED<vec<N,T>>::TYPE const& v) {
+      return map2(op::greater(), u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N, bool>
-    greaterThanEqual(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a>=b;}, u, v);
+    greaterThanEqual(expr<N,T,E> const& u, typename NONDEDUCED<vec<N,T>>::TYPE const& v) {
+      return map2(op::greater_equal(), u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N, bool>
-    equal(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a==b;}, u, v);
+    equal(expr<N,T,E> const& u, typename NONDEDUCED<vec<N,T>>::TYPE const& v) {
+      return map2(op::equal_to(), u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N, bool>
-    notEqual(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a, T b){return a!=b;}, u, v);
+    notEqual(expr<N,T,E> const& u, typename NONDEDUCED<vec<N,T>>::TYPE const& v) {
+      return map2(op::not_equal_to(), u, v);
     }
 
     template<size_t N>
+    constexpr
     bool
     any(vec<N,bool> const& u) {
       return !(u == vec<N,bool> {false});
     }
 
     template<size_t N>
+    constexpr
     bool
     all(vec<N,bool> const& u) {
       return u == vec<N,bool> {true};
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     bool
-    operator==(vec<N,T> const& u, vec<N,T> const& v) {
+    operator==(expr<N,T,L> const& u, expr<N,T,R> const& v) {
+      L const& a = u.self();
+      R const& b = v.self();
       for(size_t i=0; i<N; i++)
-        if (u[i] != v[i])
+        if (a[i] != b[i])
           return false;
       return true;
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     bool
-    operator==(mat<N,T> const& u, mat<N,T> const& v) {
+    operator==(mexpr<N,T,L> const& u, mexpr<N,T,R> const& v) {
+      L const& a = u.self();
+      R const& b = v.self();
       for(size_t i=0; i<N; i++)
-        if (u[i] != v[i])
+        if (a[i] != b[i])
           return false;
       return true;
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     bool
-    operator!=(vec<N,T> const& u, vec<N,T> const& v) {
+    operator!=(expr<N,T,L> const& u, expr<N,T,R> const& v) {
       return !(u == v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
     bool
-    operator!=(mat<N,T> const& u, mat<N,T> const& v) {
+    operator!=(mexpr<N,T,L> const& u, mexpr<N,T,R> const& v) {
       return !(u == v);
     }
 
+    constexpr
     double
     radians(double x) {
       return x * M_PI / 180.0;
     }
 
+    constexpr
     double
     degrees(double x) {
       return x / M_PI * 180.0;
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N,T>
-    radians(vec<N,T> const& u) {
+    radians(expr<N,T,E> const& u) {
       return map1([](T a){return radians(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
+    constexpr
     vec<N,T>
-    degrees(vec<N,T> const& u) {
+    degrees(expr<N,T,E> const& u) {
       return map1([](T a){return degrees(a);}, u);
     }
 
+    template<typename T>
+    using if_scalar = ::std::enable_if_t<SCALAR_TYPE<T>>;
+
+    template<typename T, typename = if_scalar<T>>
+    constexpr
+    T
+    sign(T x) {
+      return (x>0)-(x<0);
+    }
+
+    template<size_t N, typename T, typename E>
+    constexpr
+    vec<N,T>
+    sign(expr<N,T,E> const& u) {
+      return map1([](T a){return sign(a);}, u);
+    }
+
+    template<typename T, typename = if_scalar<T>>
+    constexpr
+    T
+    min(T x, T y) {
+      return ::std::min(x, y);
+    }
+
+    template<typename T, typename = if_scalar<T>>
+    constexpr
+    T
+    max(T x, T y) {
+      return ::std::max(x, y);
+    }
+
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
+    vec<N,T>
+    min(expr<N,T,L> const& u, expr<N,T,R> const& v) {
+      return map2(op::minimum(), u, v);
+    }
+
+    template<size_t N, typename T, typename E>
+    constexpr
+    vec<N,T>
+    min(expr<N,T,E> const& u, T v) {
+      return min(u, scalar<N,T>(v));
+    }
+
+    template<size_t N, typename T, typename L, typename R>
+    constexpr
+    vec<N,T>
+    max(expr<N,T,L> const& u, expr<N,T,R> const& v) {
+      return map2(op::maximum(), u, v);
+    }
+
+    template<size_t N, typename T, typename E>
+    constexpr
+    vec<N,T>
+    max(expr<N,T,E> const& u, T v) {
+      return max(u, scalar<N,T>(v));
+    }
+
+    template<typename T, typename = if_scalar<T>>
+    constexpr
+    T
+    clamp(T x, T minVal, T maxVal) {
+      return min(max(x, minVal), maxVal);
+    }
+
+    template<size_t N, typename T, typename E, typename L, typename H>
+    constexpr
+    vec<N,T>
+    clamp(expr<N,T,E> const& u, expr<N,T,L> const& minVal, expr<N,T,H> const& maxVal) {
+      return min(max(u, minVal), maxVal);
+    }
+
+    template<size_t N, typename T, typename E>
+    constexpr
+    vec<N,T>
+    clamp(expr<N,T,E> const& u, T minVal, T maxVal) {
+      return min(max(u, minVal), maxVal);
+    }
+
+    template<typename T, typename U>
+    constexpr
+    U
+    interpolate(T const& P, U const& x, U const& y, U const& z) {
+      return P[0] * x + P[1] * y + P[2] * z;
+    }
+
+    // everything below defers to <cmath> and is not usable in constant expressions
     using ::std::sin;
     using ::std::cos;
     using ::std::tan;
@@ -464,50 +1046,51 @@ namespace gl {
     using ::std::acos;
     using ::std::atan;
 
+    inline
     double
     atan(double x, double y) {
       return ::std::atan2(x,y);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    sin(vec<N,T> const& u) {
+    sin(expr<N,T,E> const& u) {
       return map1([](T a){return sin(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    cos(vec<N,T> const& u) {
+    cos(expr<N,T,E> const& u) {
       return map1([](T a){return cos(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    tan(vec<N,T> const& u) {
+    tan(expr<N,T,E> const& u) {
       return map1([](T a){return tan(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    asin(vec<N,T> const& u) {
+    asin(expr<N,T,E> const& u) {
       return map1([](T a){return asin(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    acos(vec<N,T> const& u) {
+    acos(expr<N,T,E> const& u) {
       return map1([](T a){return acos(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    atan(vec<N,T> const& u) {
+    atan(expr<N,T,E> const& u) {
       return map1([](T a){return atan(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
     vec<N,T>
-    atan(vec<N,T> const& u, vec<N,T> const& v) {
+    atan(expr<N,T,L> const& u, expr<N,T,R> const& v) {
       return map2([](T a, T b){return atan(a,b);}, u, v);
     }
 
@@ -517,151 +1100,414 @@ namespace gl {
     using ::std::exp2;
     using ::std::log2;
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
     vec<N,T>
-    pow(vec<N,T> const& u, vec<N,T> const& v) {
+    pow(expr<N,T,L> const& u, expr<N,T,R> const& v) {
       return map2([](T a, T b){return pow(a,b);}, u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    exp(vec<N,T> const& u) {
+    exp(expr<N,T,E> const& u) {
       return map1([](T a){return exp(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    log(vec<N,T> const& u) {
+    log(expr<N,T,E> const& u) {
       return map1([](T a){return log(a);}, u);
     }
 
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    exp2(vec<N,T> const& u) {
+    exp2(expr<N,T,E> const& u) {
       return map1([](T a){return exp2(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    log2(vec<N,T> const& u) {
+    log2(expr<N,T,E> const& u) {
       return map1([](T a){return log2(a);}, u);
     }
 
     using ::std::sqrt;
 
+    inline
     double
     inversesqrt(double x) {
       return 1.0 / sqrt(x);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    sqrt(vec<N,T> const& u) {
+    sqrt(expr<N,T,E> const& u) {
       return map1([](T a){return sqrt(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    inversesqrt(vec<N,T> const& u) {
+    inversesqrt(expr<N,T,E> const& u) {
       return map1([](T a){return inversesqrt(a);}, u);
     }
 
-    using ::std::abs;
-
-    template<typename T>
+    template<size_t N, typename T, typename E>
     T
-    sign(T x) {
-      return (x>0)-(x<0);
+    length(expr<N,T,E> const& u) {
+      return sqrt(dot(u, u));
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    abs(vec<N,T> const& u) {
-      return map1([](T a){return abs(a);}, u);
+    normalize(expr<N,T,E> const& u) {
+      vec<N,T> v(u);
+      return v / length(v);
     }
 
-    template<size_t N, typename T>
+    using ::std::abs;
+
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    sign(vec<N,T> const& u) {
-      return map1([](T a){return sign(a);}, u);
+    abs(expr<N,T,E> const& u) {
+      return map1([](T a){return abs(a);}, u);
     }
 
     using ::std::floor;
     using ::std::ceil;
 
+    inline
     double
     fract(double x) {
       return x - floor(x);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    floor(vec<N,T> const& u) {
+    floor(expr<N,T,E> const& u) {
       return map1([](T a){return floor(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    ceil(vec<N,T> const& u) {
+    ceil(expr<N,T,E> const& u) {
       return map1([](T a){return ceil(a);}, u);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    fract(vec<N,T> const& u) {
+    fract(expr<N,T,E> const& u) {
       return map1([](T a){return fract(a);}, u);
     }
 
-    template<typename T>
+    template<typename T, typename = if_scalar<T>>
     T
     mod(T x, T y) {
-      return x % y;
+      return x - y * floor(x / y);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename L, typename R>
     vec<N,T>
-    mod(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a){return mod(a);}, u, v);
+    mod(expr<N,T,L> const& u, expr<N,T,R> const& v) {
+      return map2([](T a, T b){return mod(a,b);}, u, v);
     }
 
-    template<size_t N, typename T>
+    template<size_t N, typename T, typename E>
     vec<N,T>
-    mod(vec<N,T> const& u, T v) {
-      return mod(u, vec<N,T>(v));
-    }
-
-    using ::std::min;
-    using ::std::max;
-
-    template<size_t N, typename T>
-    vec<N,T>
-    min(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a){return min(a);}, u, v);
-    }
-
-    template<size_t N, typename T>
-    vec<N,T>
-    min(vec<N,T> const& u, T v) {
-      return min(u, vec<N,T>(v));
-    }
-
-    template<size_t N, typename T>
-    vec<N,T>
-    max(vec<N,T> const& u, vec<N,T> const& v) {
-      return map2([](T a){return max(a);}, u, v);
-    }
-
-    template<size_t N, typename T>
-    vec<N,T>
-    max(vec<N,T> const& u, T v) {
-      return max(u, vec<N,T>(v));
-    }
-
-    template<typename T, typename U>
-    U
-    interpolate(T const& P, U const& x, U const& y, U const& z) {
-      return P[0] * x + P[1] * y + P[2] * z;
+    mod(expr<N,T,E> const& u, T v) {
+      return mod(u, scalar<N,T>(v));
+    }
+
+    struct precision_highp {};
+    struct precision_fast {};
+
+#ifdef __SSE2__
+    namespace simd {
+      inline
+      __m128
+      ldexp(__m128 y, __m128i n) {
+        return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+      }
+
+      inline
+      __m128
+      expm(__m128 r, __m128 n) {
+        __m128 r2 = _mm_mul_ps(r, r);
+        __m128 a = madd(_mm_set1_ps(1.9875691500e-4f), r, _mm_set1_ps(1.3981999507e-3f));
+        __m128 b = madd(_mm_set1_ps(8.3334519073e-3f), r, _mm_set1_ps(4.1665795894e-2f));
+        __m128 c = madd(_mm_set1_ps(1.6666665459e-1f), r, _mm_set1_ps(5.0000001201e-1f));
+        __m128 p = madd(madd(a, r2, b), r2, c);
+        p = madd(p, r2, _mm_add_ps(r, _mm_set1_ps(1.0f)));
+        return ldexp(p, _mm_cvtps_epi32(n));
+      }
+
+      inline
+      __m128
+      saturate(__m128 y, __m128 x, __m128 lo, __m128 hi) {
+        y = _mm_andnot_ps(_mm_cmplt_ps(x, lo), y);
+        __m128 over = _mm_cmpgt_ps(x, hi);
+        y = _mm_or_ps(_mm_andnot_ps(over, y), _mm_and_ps(over, _mm_set1_ps(HUGE_VALF)));
+        return _mm_or_ps(y, _mm_cmpunord_ps(x, x));
+      }
+
+      inline
+      __m128
+      exp(__m128 x) {
+        __m128 lo = _mm_set1_ps(-87.3365479f);
+        __m128 hi = _mm_set1_ps(88.3762589f);
+        __m128 c = _mm_min_ps(_mm_max_ps(x, lo), hi);
+        __m128 n = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(c, _mm_set1_ps(1.44269504089f))));
+        __m128 r = _mm_sub_ps(c, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+        r = _mm_sub_ps(r, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+        return saturate(expm(r, n), x, lo, hi);
+      }
+
+      inline
+      __m128
+      exp2(__m128 x) {
+        __m128 lo = _mm_set1_ps(-126.0f);
+        __m128 hi = _mm_set1_ps(127.499f);
+        __m128 c = _mm_min_ps(_mm_max_ps(x, lo), hi);
+        __m128 n = _mm_cvtepi32_ps(_mm_cvtps_epi32(c));
+        return saturate(expm(_mm_mul_ps(_mm_sub_ps(c, n), _mm_set1_ps(0.693147180560f)), n), x, lo, hi);
+      }
+
+      inline
+      __m128
+      log(__m128 x) {
+        __m128 nan = _mm_cmpnge_ps(x, _mm_setzero_ps());
+        __m128 zero = _mm_cmpeq_ps(x, _mm_setzero_ps());
+        __m128 inf = _mm_cmpeq_ps(x, _mm_set1_ps(HUGE_VALF));
+        x = _mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x00800000)));
+
+        __m128i i = _mm_castps_si128(x);
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(i, 23), _mm_set1_epi32(126)));
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(i, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f000000)));
+
+        __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781186547524f));
+        e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.0f)));
+        m = _mm_add_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_and_ps(small, m));
+
+        __m128 z = _mm_mul_ps(m, m);
+        __m128 z2 = _mm_mul_ps(z, z);
+        __m128 a = madd(_mm_set1_ps(7.0376836292e-2f), m, _mm_set1_ps(-1.1514610310e-1f));
+        __m128 b = madd(_mm_set1_ps(1.1676998740e-1f), m, _mm_set1_ps(-1.2420140846e-1f));
+        __m128 c = madd(_mm_set1_ps(1.4249322787e-1f), m, _mm_set1_ps(-1.6668057665e-1f));
+        __m128 d = madd(_mm_set1_ps(2.0000714765e-1f), m, _mm_set1_ps(-2.4999993993e-1f));
+        __m128 p = madd(madd(a, z, b), z2, madd(c, z, d));
+        p = madd(p, m, _mm_set1_ps(3.3333331174e-1f));
+        p = _mm_mul_ps(_mm_mul_ps(p, m), z);
+        p = madd(e, _mm_set1_ps(-2.12194440e-4f), p);
+        p = _mm_sub_ps(p, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+        __m128 r = madd(e, _mm_set1_ps(0.693359375f), _mm_add_ps(m, p));
+
+        r = _mm_or_ps(_mm_andnot_ps(zero, r), _mm_and_ps(zero, _mm_set1_ps(-HUGE_VALF)));
+        r = _mm_or_ps(_mm_andnot_ps(inf, r), _mm_and_ps(inf, _mm_set1_ps(HUGE_VALF)));
+        return _mm_or_ps(r, nan);
+      }
+
+      inline
+      __m128
+      log2(__m128 x) {
+        return _mm_mul_ps(log(x), _mm_set1_ps(1.44269504089f));
+      }
+
+      inline
+      __m128
+      pow(__m128 x, __m128 y) {
+        return exp2(_mm_mul_ps(y, log2(x)));
+      }
+
+      inline
+      void
+      sincos(__m128 x, __m128& s, __m128& c) {
+        __m128 sign = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+        x = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+
+        __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        __m128 y = _mm_cvtepi32_ps(j);
+
+        __m128 swap = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+        __m128 poly = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+        __m128 csign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+
+        x = madd(y, _mm_set1_ps(-0.78515625f), x);
+        x = madd(y, _mm_set1_ps(-2.4187564849853515625e-4f), x);
+        x = madd(y, _mm_set1_ps(-3.77489497744594108e-8f), x);
+
+        __m128 z = _mm_mul_ps(x, x);
+        __m128 p = _mm_set1_ps(2.443315711809948e-5f);
+        p = madd(p, z, _mm_set1_ps(-1.388731625493765e-3f));
+        p = madd(p, z, _mm_set1_ps(4.166664568298827e-2f));
+        p = _mm_mul_ps(_mm_mul_ps(p, z), z);
+        p = _mm_add_ps(_mm_sub_ps(p, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+        __m128 q = _mm_set1_ps(-1.9515295891e-4f);
+        q = madd(q, z, _mm_set1_ps(8.3321608736e-3f));
+        q = madd(q, z, _mm_set1_ps(-1.6666654611e-1f));
+        q = madd(_mm_mul_ps(q, z), x, x);
+
+        s = _mm_or_ps(_mm_and_ps(poly, q), _mm_andnot_ps(poly, p));
+        c = _mm_or_ps(_mm_and_ps(poly, p), _mm_andnot_ps(poly, q));
+        s = _mm_xor_ps(s, _mm_xor_ps(sign, swap));
+        c = _mm_xor_ps(c, csign);
+      }
+
+      inline
+      __m128
+      sin(__m128 x) {
+        __m128 s, c;
+        sincos(x, s, c);
+        return s;
+      }
+
+      inline
+      __m128
+      cos(__m128 x) {
+        __m128 s, c;
+        sincos(x, s, c);
+        return c;
+      }
+
+      inline
+      __m128
+      tan(__m128 x) {
+        __m128 s, c;
+        sincos(x, s, c);
+        return _mm_div_ps(s, c);
+      }
+
+      inline
+      __m128
+      sqrt(__m128 x) {
+        return _mm_sqrt_ps(x);
+      }
+
+      inline
+      __m128
+      inversesqrt(__m128 x) {
+        __m128 y = _mm_rsqrt_ps(x);
+        __m128 h = _mm_mul_ps(_mm_mul_ps(x, _mm_set1_ps(0.5f)), _mm_mul_ps(y, y));
+        __m128 r = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), h));
+
+        // rsqrtps is already exact at 0 and inf, where the Newton step gives NaN
+        __m128 exact = _mm_or_ps(_mm_cmpeq_ps(x, _mm_setzero_ps()), _mm_cmpeq_ps(x, _mm_set1_ps(HUGE_VALF)));
+        return _mm_or_ps(_mm_andnot_ps(exact, r), _mm_and_ps(exact, y));
+      }
+    }
+#endif
+
+    // precision_fast: approximations evaluated on whole float vec3/vec4
+    // packets, max error against the exact result
+    //   exp, exp2 1.3 ulp; log 1 ulp; log2 2 ulp
+    //   sin, cos 1.5 ulp on [-pi, pi], 1.3 * 2^-24 absolute for |x| < 8192
+    //   tan 3 ulp on [-1.5, 1.5]; inversesqrt 3.5 ulp
+    //   pow 2.3 ulp * max(1, |y * log2(x)|)
+    // exp, exp2 and pow flush results below 2^-126 to 0 and above 2^127.5
+    // to inf. NaN gives NaN, log(inf) is inf and inversesqrt(0) is inf.
+    // A single lane is no faster than libm, so scalars other than
+    // inversesqrt, other types and builds without SSE2 use the precise
+    // functions.
+    namespace fast {
+#ifdef __SSE2__
+      using simd::sin;
+      using simd::cos;
+      using simd::tan;
+      using simd::exp;
+      using simd::exp2;
+      using simd::log;
+      using simd::log2;
+      using simd::pow;
+      using simd::sqrt;
+      using simd::inversesqrt;
+
+      inline float inversesqrt(float x) { return _mm_cvtss_f32(simd::inversesqrt(_mm_set_ss(x))); }
+#endif
+
+      template<typename T, typename = if_scalar<T>> auto sin(T x) { return sl::sin(x); }
+      template<typename T, typename = if_scalar<T>> auto cos(T x) { return sl::cos(x); }
+      template<typename T, typename = if_scalar<T>> auto tan(T x) { return sl::tan(x); }
+      template<typename T, typename = if_scalar<T>> auto exp(T x) { return sl::exp(x); }
+      template<typename T, typename = if_scalar<T>> auto exp2(T x) { return sl::exp2(x); }
+      template<typename T, typename = if_scalar<T>> auto log(T x) { return sl::log(x); }
+      template<typename T, typename = if_scalar<T>> auto log2(T x) { return sl::log2(x); }
+      template<typename T, typename = if_scalar<T>> auto pow(T x, T y) { return sl::pow(x, y); }
+      template<typename T, typename = if_scalar<T>> auto sqrt(T x) { return sl::sqrt(x); }
+      template<typename T, typename = if_scalar<T>> auto inversesqrt(T x) { return sl::inversesqrt(x); }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      sin(expr<N,T,E> const& u) {
+        return map1([](auto a){return sin(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      cos(expr<N,T,E> const& u) {
+        return map1([](auto a){return cos(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      tan(expr<N,T,E> const& u) {
+        return map1([](auto a){return tan(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      exp(expr<N,T,E> const& u) {
+        return map1([](auto a){return exp(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      exp2(expr<N,T,E> const& u) {
+        return map1([](auto a){return exp2(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      log(expr<N,T,E> const& u) {
+        return map1([](auto a){return log(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      log2(expr<N,T,E> const& u) {
+        return map1([](auto a){return log2(a);}, u);
+      }
+
+      template<size_t N, typename T, typename L, typename R>
+      vec<N,T>
+      pow(expr<N,T,L> const& u, expr<N,T,R> const& v) {
+        return map2([](auto a, auto b){return pow(a, b);}, u, v);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      sqrt(expr<N,T,E> const& u) {
+        return map1([](auto a){return sqrt(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      inversesqrt(expr<N,T,E> const& u) {
+        return map1([](auto a){return inversesqrt(a);}, u);
+      }
+
+      template<size_t N, typename T, typename E>
+      T
+      length(expr<N,T,E> const& u) {
+        return sqrt(dot(u, u));
+      }
+
+      template<size_t N, typename T, typename E>
+      vec<N,T>
+      normalize(expr<N,T,E> const& u) {
+        vec<N,T> v(u);
+        return v * T(inversesqrt(dot(v, v)));
+      }
     }
   }
+  }
 }
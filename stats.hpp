@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+
+#ifdef GL_STATISTICS
+#define GL_STAT(...) __VA_ARGS__
+#else
+#define GL_STAT(...)
+#endif
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
+namespace gl {
+  inline namespace GL_ISA {
+  namespace stats {
+    using ::std::uint64_t;
+
+    struct Statistics {
+      uint64_t draws_submitted;
+      uint64_t draws_culled;
+      uint64_t draws_occluded;
+      uint64_t vertex_shader_invocations;
+      uint64_t triangles_submitted;
+      uint64_t triangles_culled;
+      uint64_t triangles_crossing_edge;
+      uint64_t blocks_tested;
+      uint64_t blocks_rejected;
+      uint64_t blocks_accepted;
+      uint64_t fragments_tested;
+      uint64_t fragments_shaded;
+      uint64_t fragments_written;
+      uint64_t tiles_signed;
+      uint64_t tiles_kept;
+      uint64_t vertex_cycles;
+      uint64_t raster_cycles;
+      uint64_t fragment_cycles;
+
+      Statistics&
+      operator+=(Statistics const& s) {
+        draws_submitted += s.draws_submitted;
+        draws_culled += s.draws_culled;
+        draws_occluded += s.draws_occluded;
+        vertex_shader_invocations += s.vertex_shader_invocations;
+        triangles_submitted += s.triangles_submitted;
+        triangles_culled += s.triangles_culled;
+        triangles_crossing_edge += s.triangles_crossing_edge;
+        blocks_tested += s.blocks_tested;
+        blocks_rejected += s.blocks_rejected;
+        blocks_accepted += s.blocks_accepted;
+        fragments_tested += s.fragments_tested;
+        fragments_shaded += s.fragments_shaded;
+        fragments_written += s.fragments_written;
+        tiles_signed += s.tiles_signed;
+        tiles_kept += s.tiles_kept;
+        vertex_cycles += s.vertex_cycles;
+        raster_cycles += s.raster_cycles;
+        fragment_cycles += s.fragment_cycles;
+        return *this;
+      }
+    };
+
+    inline
+    uint64_t
+    cycles() {
+#if defined(__i386__) || defined(__x86_64__)
+      return __builtin_ia32_rdtsc();
+#else
+      return ::std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    inline
+    void
+    print(::std::FILE *f, Statistics const& s) {
+      ::std::fprintf(f,
+                     "draws submitted %llu culled %llu occluded %llu\n"
+                     "vertex shader invocations %llu\n"
+                     "triangles submitted %llu culled %llu crossing the edge %llu\n"
+                     "blocks tested %llu rejected %llu trivially accepted %llu\n"
+                     "fragments tested %llu shaded %llu written %llu\n"
+                     "tiles signed %llu kept %llu\n"
+                     "cycles vertex %llu raster %llu fragment %llu\n",
+                     (unsigned long long)s.draws_submitted,
+                     (unsigned long long)s.draws_culled,
+                     (unsigned long long)s.draws_occluded,
+                     (unsigned long long)s.vertex_shader_invocations,
+                     (unsigned long long)s.triangles_submitted,
+                     (unsigned long long)s.triangles_culled,
+                     (unsigned long long)s.triangles_crossing_edge,
+                     (unsigned long long)s.blocks_tested,
+                     (unsigned long long)s.blocks_rejected,
+                     (unsigned long long)s.blocks_accepted,
+                     (unsigned long long)s.fragments_tested,
+                     (unsigned long long)s.fragments_shaded,
+                     (unsigned long long)s.fragments_written,
+                     (unsigned long long)s.tiles_signed,
+                     (unsigned long long)s.tiles_kept,
+                     (unsigned long long)s.vertex_cycles,
+                     (unsigned long long)s.raster_cycles,
+                     (unsigned long long)s.fragment_cycles);
+    }
+  }
+
+  using stats::Statistics;
+  }
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "sl.hpp"
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
+namespace gl {
+  inline namespace GL_ISA {
+  namespace sl {
+    enum Filter {
+      filter_nearest,
+      filter_bilinear,
+      filter_trilinear
+    };
+
+    enum Wrap {
+      wrap_repeat,
+      wrap_clamp,
+      wrap_mirror
+    };
+
+    // RGBA8 texels with a full mip chain, generated on construction. Each level
+    // is stored as row-major 8x8 tiles, texels inside a tile in Morton order, so
+    // that a bilinear footprint usually stays within one or two cache lines.
+    struct Texture {
+      static constexpr size_t LEVELS = 16;
+      static constexpr size_t TILE = 8;
+
+      size_t levels = 0;
+      size_t w[LEVELS], h[LEVELS], tiles_w[LEVELS];
+      unsigned char (*level[LEVELS])[4] = {};
+
+      // rgba holds width*height texels, row by row starting at t = 0
+      Texture(size_t width, size_t height, unsigned char const (*rgba)[4]) {
+        for(size_t x=width, y=height; levels < LEVELS; x = (x + 1) / 2, y = (y + 1) / 2) {
+          w[levels] = x;
+          h[levels] = y;
+          tiles_w[levels] = (x + TILE - 1) / TILE;
+          level[levels] = (unsigned char (*)[4])::std::calloc(tiles_w[levels] * ((y + TILE - 1) / TILE) * TILE * TILE, 4);
+          levels++;
+          if (x == 1 && y == 1)
+            break;
+        }
+
+        for(size_t y=0; y<height; y++)
+          for(size_t x=0; x<width; x++)
+            ::std::memcpy(level[0][index(0, x, y)], rgba[y*width+x], 4);
+
+        for(size_t k=1; k<levels; k++)
+          for(size_t y=0; y<h[k]; y++)
+            for(size_t x=0; x<w[k]; x++) {
+              size_t x0 = 2*x, x1 = min(2*x+1, w[k-1]-1);
+              size_t y0 = 2*y, y1 = min(2*y+1, h[k-1]-1);
+              auto a = level[k-1][index(k-1, x0, y0)], b = level[k-1][index(k-1, x1, y0)];
+              auto c = level[k-1][index(k-1, x0, y1)], d = level[k-1][index(k-1, x1, y1)];
+              for(size_t i=0; i<4; i++)
+                level[k][index(k, x, y)][i] = (a[i] + b[i] + c[i] + d[i] + 2) / 4;
+            }
+      }
+
+      Texture(Texture const&) = delete;
+
+      ~Texture() {
+        for(size_t k=0; k<levels; k++)
+          ::std::free(level[k]);
+      }
+
+      size_t
+      index(size_t k, size_t x, size_t y) const {
+        size_t m = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2 | (x & 4) << 2 | (y & 4) << 3;
+        return ((y / TILE) * tiles_w[k] + x / TILE) * TILE * TILE + m;
+      }
+
+      vec<4,float>
+      texel(size_t k, size_t x, size_t y) const {
+        auto p = level[k][index(k, x, y)];
+        return vec<4,float> {float(p[0]), float(p[1]), float(p[2]), float(p[3])} * (1.0f / 255.0f);
+      }
+    };
+
+    struct sampler2D {
+      Texture const *texture;
+      Filter filter = filter_trilinear;
+      Wrap wrap_s = wrap_repeat;
+      Wrap wrap_t = wrap_repeat;
+
+      static
+      size_t
+      wrap(Wrap mode, long i, size_t n) {
+        long m = long(n);
+        switch(mode) {
+        case wrap_clamp:
+          return size_t(i < 0 ? 0 : i >= m ? m - 1 : i);
+        case wrap_mirror:
+          i = ((i % (2*m)) + 2*m) % (2*m);
+          return size_t(i < m ? i : 2*m - 1 - i);
+        default:
+          return size_t(((i % m) + m) % m);
+        }
+      }
+
+      vec<4,float>
+      nearest(size_t k, vec<2,float> const& c) const {
+        long x = long(::std::floor(c.x * float(texture->w[k])));
+        long y = long(::std::floor(c.y * float(texture->h[k])));
+        return texture->texel(k, wrap(wrap_s, x, texture->w[k]), wrap(wrap_t, y, texture->h[k]));
+      }
+
+      vec<4,float>
+      bilinear(size_t k, vec<2,float> const& c) const {
+        float u = c.x * float(texture->w[k]) - 0.5f;
+        float v = c.y * float(texture->h[k]) - 0.5f;
+        float fu = ::std::floor(u), fv = ::std::floor(v);
+        float a = u - fu, b = v - fv;
+
+        size_t x0 = wrap(wrap_s, long(fu), texture->w[k]), x1 = wrap(wrap_s, long(fu) + 1, texture->w[k]);
+        size_t y0 = wrap(wrap_t, long(fv), texture->h[k]), y1 = wrap(wrap_t, long(fv) + 1, texture->h[k]);
+
+        vec<4,float> t0 = texture->texel(k, x0, y0) * (1.0f - a) + texture->texel(k, x1, y0) * a;
+        vec<4,float> t1 = texture->texel(k, x0, y1) * (1.0f - a) + texture->texel(k, x1, y1) * a;
+        return t0 * (1.0f - b) + t1 * b;
+      }
+
+      // lod is log2 of texels per pixel at level 0
+      vec<4,float>
+      sample(vec<2,float> const& c, float lod) const {
+        float top = float(texture->levels - 1);
+        lod = (lod > 0.0f) ? min(lod, top) : 0.0f;
+
+        switch(filter) {
+        case filter_nearest:
+          return nearest(size_t(lod + 0.5f), c);
+        case filter_bilinear:
+          return bilinear(size_t(lod + 0.5f), c);
+        default: {
+          size_t k = size_t(lod);
+          float f = lod - float(k);
+          if (f == 0.0f)
+            return bilinear(k, c);
+          return bilinear(k, c) * (1.0f - f) + bilinear(k + 1, c) * f;
+        }
+        }
+      }
+    };
+
+    template<typename T, typename E>
+    vec<4,T>
+    texture2DLod(sampler2D const& s, expr<2,T,E> const& coord, float lod) {
+      return vec<4,T>(s.sample(vec<2,float>(vec<2,T>(coord)), lod));
+    }
+
+    // lanes of the float8 instance of a fragment shader: the pixel, its
+    // horizontal and its vertical neighbour in the 2x2 quad, then the pixel again
+    constexpr size_t QUAD_LANES = 3;
+
+    template<typename E>
+    vec<4,float8>
+    texture2DLod(sampler2D const& s, expr<2,float8,E> const& coord, float lod) {
+      vec<2,float8> c = coord;
+      vec<4,float8> r;
+
+      for(size_t l=0; l<QUAD_LANES; l++) {
+        vec<4,float> t = s.sample({c[0][l], c[1][l]}, lod);
+        for(size_t i=0; i<4; i++)
+          r[i][l] = t[i];
+      }
+
+      for(size_t l=QUAD_LANES; l<float8::LANES; l++)
+        for(size_t i=0; i<4; i++)
+          r[i][l] = r[i][0];
+      return r;
+    }
+
+    // Level 0, but for the float8 instance of a fragment shader, whose lanes give
+    // the derivatives of the coordinates.
+    template<typename T, typename E>
+    vec<4,T>
+    texture2D(sampler2D const& s, expr<2,T,E> const& coord) {
+      return texture2DLod(s, coord, 0.0f);
+    }
+
+    template<typename E>
+    vec<4,float8>
+    texture2D(sampler2D const& s, expr<2,float8,E> const& coord) {
+      vec<2,float8> c = coord;
+      vec<2,float> size = {float(s.texture->w[0]), float(s.texture->h[0])};
+      vec<2,float> c0 = {c[0][0], c[1][0]};
+      vec<2,float> dx = (vec<2,float> {c[0][1], c[1][1]} - c0) * size;
+      vec<2,float> dy = (vec<2,float> {c[0][2], c[1][2]} - c0) * size;
+      float rho = max(dot(dx, dx), dot(dy, dy));
+      return texture2DLod(s, c, (rho > 0.0f) ? 0.5f * ::std::log2(rho) : 0.0f);
+    }
+  }
+  }
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define TRACE_EVENTS 65536
+
+struct event {
+  const char *name;
+  uint64_t begin;
+  uint64_t end;
+  pid_t tid;
+};
+
+/* rings are never freed, but taken over by new threads once their thread exits */
+struct ring {
+  struct ring *next;
+  atomic_bool busy;
+  pid_t tid;
+  atomic_size_t head;
+  struct event events[TRACE_EVENTS];
+};
+
+bool trace_enabled = false;
+
+static const char *trace_path;
+static _Atomic(struct ring *) rings;
+static _Thread_local struct ring *ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+uint64_t
+trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+release_ring(void *r) {
+  atomic_store_explicit(&((struct ring *)r)->busy, false, memory_order_release);
+}
+
+static void
+create_key(void) {
+  pthread_key_create(&ring_key, release_ring);
+}
+
+static struct ring *
+new_ring(void) {
+  pthread_once(&ring_once, create_key);
+
+  struct ring *r;
+  for(r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next) {
+    bool idle = false;
+    if (atomic_compare_exchange_strong_explicit(&r->busy, &idle, true, memory_order_acquire, memory_order_relaxed))
+      break;
+  }
+
+  if (!r) {
+    r = calloc(1, sizeof(struct ring));
+    if (!r)
+      return NULL;
+
+    atomic_init(&r->busy, true);
+    r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while(!atomic_compare_exchange_weak_explicit(&rings, &r->next, r, memory_order_release, memory_order_relaxed)) {
+    }
+  }
+
+  r->tid = syscall(SYS_gettid);
+  pthread_setspecific(ring_key, r);
+  return r;
+}
+
+void
+trace_complete(const char *name, uint64_t begin, uint64_t end) {
+  if (!ring)
+    ring = new_ring();
+  if (!ring)
+    return;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  ring->events[head % TRACE_EVENTS] = (struct event){name, begin, end, ring->tid};
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void
+trace_dump(void) {
+  if (!trace_enabled)
+    return;
+
+  FILE *f = fopen(trace_path, "w");
+  if (!f) {
+    perror(trace_path);
+    return;
+  }
+
+  pid_t pid = getpid();
+  const char *sep = "";
+
+  fprintf(f, "{\"traceEvents\":[");
+
+  for(struct ring *r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t tail = (head > TRACE_EVENTS) ? head - TRACE_EVENTS : 0;
+
+    for(size_t i=tail; i<head; i++) {
+      struct event e = r->events[i % TRACE_EVENTS];
+
+      /* the thread may still be tracing, and have overwritten the event while it was copied */
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&r->head, memory_order_relaxed) >= i + TRACE_EVENTS)
+        continue;
+
+      fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              sep, e.name, pid, e.tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+      sep = ",";
+    }
+  }
+
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(f);
+}
+
+void
+trace_init(void) {
+  trace_path = getenv("TRIANGLE_TRACE");
+  if (!trace_path || !*trace_path)
+    return;
+
+  trace_enabled = true;
+  atexit(trace_dump);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern bool trace_enabled;
+
+void trace_init(void);
+void trace_dump(void);
+uint64_t trace_now(void);
+void trace_complete(const char *name, uint64_t begin, uint64_t end);
+
+#ifdef __cplusplus
+}
+
+#ifndef GL_ISA
+#define GL_ISA generic
+#endif
+
+namespace gl {
+  inline namespace GL_ISA {
+  namespace trace {
+    struct Scope {
+      const char *name;
+      uint64_t begin;
+
+      Scope(const char *name) : name(name), begin(trace_enabled ? trace_now() : 0) {
+      }
+
+      ~Scope() {
+        if (trace_enabled)
+          trace_complete(name, begin, trace_now());
+      }
+    };
+  }
+  }
+}
+#endif
+
+#define TRACE_BEGIN(v) uint64_t v = trace_enabled ? trace_now() : 0
+#define TRACE_END(v, name) if (trace_enabled) trace_complete(name, v, trace_now())
@@ -5,8 +5,14 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
+#include "presentation-time-client-protocol.h"
+#include "trace.h"
+#include "cluster.h"
+#include "present.h"
 
 
 #define ASSERT(cond, msg)                       \
@@ -23,6 +29,8 @@ struct client {
   struct wl_compositor *compositor;
   struct wl_shell *shell;
   struct wl_shm *shm;
+  struct wp_presentation *presentation;
+  bool rgb565;
 };
 
 struct window{
@@ -31,8 +39,28 @@ struct window{
   struct wl_buffer *buffers[2];
   bool busy[2];
   void *buffer;
+  struct wp_presentation *presentation;
 };
 
+bool format_rgb565(void);
+void set_format_rgb565(bool enable);
+
+static void
+handle_format(void *data, struct wl_shm *shm __attribute__((unused)), uint32_t format) {
+  struct client *client = (struct client *)data;
+
+  if (format == WL_SHM_FORMAT_RGB565)
+    client->rgb565 = true;
+}
+
+static const struct wl_shm_listener shm_listener = { handle_format };
+
+static void
+handle_clock_id(void *data __attribute__((unused)), struct wp_presentation *presentation __attribute__((unused)), uint32_t clock) {
+  present_clock(clock);
+}
+
+static const struct wp_presentation_listener presentation_listener = { handle_clock_id };
 
 static void
 registry_handler(void *data, struct wl_registry *registry, uint32_t id, const char *interface, uint32_t version __attribute__((unused))) {
@@ -44,6 +72,10 @@ registry_handler(void *data, struct wl_registry *registry, uint32_t id, const ch
     client->shell = wl_registry_bind(registry, id, &wl_shell_interface, 1);
   } else if(strcmp(interface, "wl_shm") == 0) {
     client->shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
+    wl_shm_add_listener(client->shm, &shm_listener, client);
+  } else if(strcmp(interface, wp_presentation_interface.name) == 0) {
+    client->presentation = wl_registry_bind(registry, id, &wp_presentation_interface, 1);
+    wp_presentation_add_listener(client->presentation, &presentation_listener, NULL);
   }
 }
 
@@ -63,6 +95,12 @@ init_client(struct client *client) {
   ASSERT(client->shell, "no shell");
   ASSERT(client->shm, "no shm");
   wl_display_roundtrip(client->display);
+
+  /* only ARGB8888 and XRGB8888 are always supported */
+  if (format_rgb565() && !client->rgb565) {
+    fprintf(stderr, "compositor does not support RGB565, using XRGB8888\n");
+    set_format_rgb565(false);
+  }
 }
 
 
@@ -84,16 +122,44 @@ buffer_release(void *data, struct wl_buffer *buffer) {
 
 static const struct wl_buffer_listener buffer_listener = { buffer_release };
 
+static void
+feedback_sync_output(void *data __attribute__((unused)), struct wp_presentation_feedback *feedback __attribute__((unused)), struct wl_output *output __attribute__((unused))) {
+}
+
+static void
+feedback_presented(void *data, struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags) {
+  uint64_t sec = (uint64_t)tv_sec_hi << 32 | tv_sec_lo;
+  present_presented((uint32_t)(uintptr_t)data, sec * 1000000000 + tv_nsec, refresh, (uint64_t)seq_hi << 32 | seq_lo, flags);
+  wp_presentation_feedback_destroy(feedback);
+}
+
+static void
+feedback_discarded(void *data, struct wp_presentation_feedback *feedback) {
+  present_discarded((uint32_t)(uintptr_t)data);
+  wp_presentation_feedback_destroy(feedback);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = { feedback_sync_output, feedback_presented, feedback_discarded };
+
 extern const size_t width;
 extern const size_t height;
 
-void draw(unsigned char buffer[][4]);
+void draw(void *buffer);
+
+static bool cluster = false;
+
+static size_t
+pixel_size(void) {
+  return format_rgb565() ? 2 : 4;
+}
 
 static const struct wl_callback_listener frame_listener;
 
 static void
-redraw(void *data, struct wl_callback *callback, uint32_t time __attribute__((unused))) {
+redraw(void *data, struct wl_callback *callback, uint32_t time) {
   struct window *window = data;
+  TRACE_BEGIN(redraw_begin);
+  uint32_t frame = present_begin(time);
 
   if (callback)
     wl_callback_destroy(callback);
@@ -107,22 +173,39 @@ redraw(void *data, struct wl_callback *callback, uint32_t time __attribute__((un
   ASSERT(b != -1, "no buffer available");
   window->busy[b] = true;
 
-  size_t size = width*height * 4;
+  size_t size = width*height * pixel_size();
 
-  draw(window->buffer + b*size);
+  present_mark(frame, PRESENT_RENDER_BEGIN);
+  if (cluster)
+    cluster_draw(window->buffer + b*size);
+  else
+    draw(window->buffer + b*size);
+  present_mark(frame, PRESENT_RENDER_END);
 
+  TRACE_BEGIN(attach_begin);
   wl_surface_attach(window->surface, window->buffers[b], 0, 0);
   wl_surface_damage(window->surface, 0, 0, width, height);
+  TRACE_END(attach_begin, "attach");
 
+  TRACE_BEGIN(commit_begin);
   callback = wl_surface_frame(window->surface);
   wl_callback_add_listener(callback, &frame_listener, window);
+  if (window->presentation && present_enabled) {
+    struct wp_presentation_feedback *feedback = wp_presentation_feedback(window->presentation, window->surface);
+    wp_presentation_feedback_add_listener(feedback, &feedback_listener, (void *)(uintptr_t)frame);
+  }
+  present_mark(frame, PRESENT_COMMIT);
   wl_surface_commit(window->surface);
+  TRACE_END(commit_begin, "commit");
+
+  TRACE_END(redraw_begin, "redraw");
 }
 
 static const struct wl_callback_listener frame_listener = { redraw };
 
 static void
 create_window(struct client *client, struct window *window) {
+  window->presentation = client->presentation;
   window->surface = wl_compositor_create_surface(client->compositor);
   ASSERT(window->surface, "cannot create surface");
   window->shell_surface = wl_shell_get_shell_surface(client->shell, window->surface);
@@ -134,7 +217,7 @@ create_window(struct client *client, struct window *window) {
   int fd = open("/dev/shm", O_TMPFILE|O_CLOEXEC|O_RDWR, S_IRUSR|S_IWUSR);
   ASSERT(fd != -1, "cannot create shm");
 
-  int size = width*height*4;
+  int size = width*height*pixel_size();
 
   ASSERT(ftruncate(fd, size*2) == 0, strerror(errno));
 
@@ -142,7 +225,7 @@ create_window(struct client *client, struct window *window) {
   ASSERT(pool, "cannot create pool");
 
   for(int i=0; i<2; i++) {
-    window->buffers[i] = wl_shm_pool_create_buffer(pool, i*size, width, height, width*4, WL_SHM_FORMAT_XRGB8888);
+    window->buffers[i] = wl_shm_pool_create_buffer(pool, i*size, width, height, width*pixel_size(), format_rgb565() ? WL_SHM_FORMAT_RGB565 : WL_SHM_FORMAT_XRGB8888);
     ASSERT(window->buffers[i], "cannot create buffer");
     wl_buffer_add_listener(window->buffers[i], &buffer_listener, window);
   }
@@ -157,9 +240,52 @@ create_window(struct client *client, struct window *window) {
 }
 
 
+/* written to by signal handlers, so that poll wakes up even with no events */
+static int quit_pipe[2];
+
+static void
+handle_signal(int sig __attribute__((unused))) {
+  int saved = errno;
+  ssize_t n __attribute__((unused)) = write(quit_pipe[1], "", 1);
+  errno = saved;
+}
+
 static void
 main_loop(struct client *client) {
-  while (wl_display_dispatch(client->display) != -1) {
+  struct pollfd fds[2] = {
+    { .fd = wl_display_get_fd(client->display), .events = POLLIN },
+    { .fd = quit_pipe[0], .events = POLLIN },
+  };
+
+  for(;;) {
+    while (wl_display_prepare_read(client->display) != 0)
+      if (wl_display_dispatch_pending(client->display) < 0)
+        return;
+    wl_display_flush(client->display);
+
+    if (poll(fds, 2, -1) < 0) {
+      wl_display_cancel_read(client->display);
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+
+    if (fds[1].revents) {
+      wl_display_cancel_read(client->display);
+      return;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      if (wl_display_read_events(client->display) < 0)
+        return;
+    } else {
+      wl_display_cancel_read(client->display);
+      if (fds[0].revents & (POLLERR | POLLHUP))
+        return;
+    }
+
+    if (wl_display_dispatch_pending(client->display) < 0)
+      return;
   }
 }
 
@@ -168,7 +294,22 @@ main() {
   struct client client = {0};
   struct window window = {0};
 
+  trace_init();
+  present_init();
+
+  /* before forking workers, so that they render the format the compositor takes */
   init_client(&client);
+
+  const char *workers = getenv("TRIANGLE_WORKERS");
+  if (workers) {
+    cluster = cluster_init(workers) > 0;
+    ASSERT(cluster, "cannot start workers");
+  }
+
+  ASSERT(pipe2(quit_pipe, O_CLOEXEC | O_NONBLOCK) == 0, strerror(errno));
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
   create_window(&client, &window);
   main_loop(&client);
 }
@@ -0,0 +1,15 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cluster.h"
+#include "trace.h"
+
+int
+main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s unix:PATH | HOST:PORT\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  trace_init();
+  return cluster_serve(argv[1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}